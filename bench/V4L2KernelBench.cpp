@@ -0,0 +1,318 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Micro-benchmark of the per-frame pixel kernels.
+//
+// For each kernel, image size and SIMD level compiled in the plugin,
+// reports the throughput (source + destination bytes) and the number
+// of cpu cycles (time stamp counter) per source pixel.
+//
+// usage: v4l2_kernel_bench [min_time_in_s]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC
+#endif
+
+#include "V4L2PixelKernels.h"
+
+using namespace lima::V4L2;
+
+static double _now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long _cycles()
+{
+#ifdef HAS_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct ImageSize
+{
+  const char* name;
+  int width;
+  int height;
+};
+
+struct Job
+{
+  const unsigned char* src;
+  unsigned char* dst;
+  int width;
+  int height;
+  int kernel;
+};
+
+typedef void (*RunFunc)(const Kernels::Table&,const Job&);
+
+// source and destination bytes for one run
+typedef double (*BytesFunc)(const Job&);
+
+static void _run_conv(const Kernels::Table& t,const Job& j)
+{
+  Kernels::Kernel k = Kernels::Kernel(j.kernel);
+  t.conv[k](j.src,Kernels::getSrcLineSize(k,j.width),j.dst,j.width,j.height);
+}
+static double _bytes_conv(const Job& j)
+{
+  Kernels::Kernel k = Kernels::Kernel(j.kernel);
+  return double(Kernels::getSrcLineSize(k,j.width)) * j.height +
+    double(j.width) * j.height * Kernels::getDstPixelDepth(k);
+}
+
+// centered half size roi of a Y16 image
+static void _run_crop(const Kernels::Table& t,const Job& j)
+{
+  int stride = j.width * 2;
+  t.crop(j.src + j.height / 4 * stride + j.width / 2,stride,
+	 j.dst,stride / 2,j.height / 2);
+}
+static double _bytes_crop(const Job& j)
+{
+  return double(j.width) * j.height;
+}
+
+static void _run_bin8(const Kernels::Table& t,const Job& j)
+{
+  t.bin[Kernels::Pixel8](j.src,j.width,j.dst,j.width / 2,j.height / 2,2,2);
+}
+static double _bytes_bin8(const Job& j)
+{
+  return double(j.width) * j.height * 5 / 4;
+}
+
+static void _run_bin16(const Kernels::Table& t,const Job& j)
+{
+  t.bin[Kernels::Pixel16](j.src,j.width * 2,j.dst,j.width / 2,j.height / 2,2,2);
+}
+static double _bytes_bin16(const Job& j)
+{
+  return double(j.width) * j.height * 5 / 2;
+}
+
+static void _run_bin2x2_8(const Kernels::Table& t,const Job& j)
+{
+  t.bin2x2[Kernels::Pixel8](j.src,j.width,j.dst,j.width / 2,j.height / 2,2,2);
+}
+
+static void _run_bin2x2_16(const Kernels::Table& t,const Job& j)
+{
+  t.bin2x2[Kernels::Pixel16](j.src,j.width * 2,j.dst,j.width / 2,j.height / 2,2,2);
+}
+
+static void _run_bin4x4_16(const Kernels::Table& t,const Job& j)
+{
+  t.bin4x4[Kernels::Pixel16](j.src,j.width * 2,j.dst,j.width / 4,j.height / 4,4,4);
+}
+static double _bytes_bin4x4_16(const Job& j)
+{
+  return double(j.width) * j.height * 17 / 8;
+}
+
+static void _run_stat8(const Kernels::Table& t,const Job& j)
+{
+  Kernels::Statistics stat;
+  t.stat[Kernels::Pixel8](j.src,j.width,j.height,stat);
+}
+static double _bytes_stat8(const Job& j)
+{
+  return double(j.width) * j.height;
+}
+
+static void _run_stat16(const Kernels::Table& t,const Job& j)
+{
+  Kernels::Statistics stat;
+  t.stat[Kernels::Pixel16](j.src,j.width,j.height,stat);
+}
+static double _bytes_stat16(const Job& j)
+{
+  return double(j.width) * j.height * 2;
+}
+
+// sum and weight planes followed by the merged image, all in dst
+static void _run_hdr_acc16(const Kernels::Table& t,const Job& j)
+{
+  int nb_pixels = j.width * j.height;
+  float* sum = (float*)j.dst;
+  t.hdr_acc[Kernels::Pixel16](j.src,nb_pixels,1e-3f,65535.f,sum,sum + nb_pixels);
+}
+static double _bytes_hdr_acc16(const Job& j)
+{
+  return double(j.width) * j.height * (2 + 16);
+}
+
+static void _run_hdr_merge(const Kernels::Table& t,const Job& j)
+{
+  int nb_pixels = j.width * j.height;
+  float* sum = (float*)j.dst;
+  t.hdr_merge(sum,sum + nb_pixels,nb_pixels,1e-2f,65535.f,
+	      (unsigned int*)(sum + 2 * nb_pixels));
+}
+static double _bytes_hdr_merge(const Job& j)
+{
+  return double(j.width) * j.height * 12;
+}
+
+// 32 bits accumulator in dst
+static void _run_acc16(const Kernels::Table& t,const Job& j)
+{
+  t.acc[Kernels::Pixel16](j.src,j.width * j.height,(unsigned int*)j.dst);
+}
+static double _bytes_acc16(const Job& j)
+{
+  return double(j.width) * j.height * (2 + 8);
+}
+
+static void _run_avg16(const Kernels::Table& t,const Job& j)
+{
+  unsigned int* acc = (unsigned int*)j.dst;
+  int nb_pixels = j.width * j.height;
+  t.avg[Kernels::Pixel16](acc,nb_pixels,100,(unsigned char*)(acc + nb_pixels));
+}
+static double _bytes_avg16(const Job& j)
+{
+  return double(j.width) * j.height * (4 + 2);
+}
+
+// dark and gain planes in dst, filled by the hdr cases
+static void _run_flat_field16(const Kernels::Table& t,const Job& j)
+{
+  int nb_pixels = j.width * j.height;
+  float* dark = (float*)j.dst;
+  t.flat_field[Kernels::Pixel16](j.src,nb_pixels,dark,dark + nb_pixels,
+				 (unsigned short*)(dark + 2 * nb_pixels));
+}
+static double _bytes_flat_field16(const Job& j)
+{
+  return double(j.width) * j.height * (2 + 8 + 2);
+}
+
+struct Case
+{
+  const char* name;
+  RunFunc run;
+  BytesFunc bytes;
+  int kernel;
+};
+
+int main(int argc,char* argv[])
+{
+  double min_time = argc > 1 ? atof(argv[1]) : 0.2;
+
+  static const ImageSize sizes[] = {{"VGA",640,480},
+				    {"HD",1280,720},
+				    {"FHD",1920,1080},
+				    {"4K",3840,2160}};
+  int nb_sizes = sizeof(sizes) / sizeof(ImageSize);
+  const ImageSize& biggest = sizes[nb_sizes - 1];
+
+  std::vector<Case> cases;
+  for(int k = 0;k < Kernels::NbKernel;++k)
+    {
+      Case c = {Kernels::getKernelName(Kernels::Kernel(k)),_run_conv,_bytes_conv,k};
+      cases.push_back(c);
+    }
+  Case others[] = {{"crop Y16",_run_crop,_bytes_crop,0},
+		   {"bin 2x2 Y8",_run_bin8,_bytes_bin8,0},
+		   {"bin 2x2 Y16",_run_bin16,_bytes_bin16,0},
+		   {"bin2x2 Y8",_run_bin2x2_8,_bytes_bin8,0},
+		   {"bin2x2 Y16",_run_bin2x2_16,_bytes_bin16,0},
+		   {"bin4x4 Y16",_run_bin4x4_16,_bytes_bin4x4_16,0},
+		   {"stat Y8",_run_stat8,_bytes_stat8,0},
+		   {"stat Y16",_run_stat16,_bytes_stat16,0},
+		   {"hdr acc Y16",_run_hdr_acc16,_bytes_hdr_acc16,0},
+		   {"hdr merge",_run_hdr_merge,_bytes_hdr_merge,0},
+		   {"acc Y16",_run_acc16,_bytes_acc16,0},
+		   {"avg Y16",_run_avg16,_bytes_avg16,0},
+		   {"flat field Y16",_run_flat_field16,_bytes_flat_field16,0}};
+  cases.insert(cases.end(),others,others + sizeof(others) / sizeof(Case));
+
+  std::vector<unsigned char> src(biggest.width * 4 * biggest.height);
+  std::vector<unsigned char> dst(biggest.width * 12 * biggest.height);
+  srand(0);
+  for(size_t i = 0;i < src.size();++i)
+    src[i] = (unsigned char)rand();
+
+  printf("best SIMD level on this cpu: %s, selected: %s\n\n",
+	 Kernels::getSimdLevelName(Kernels::getBestSimdLevel()),
+	 Kernels::getSimdLevelName(Kernels::getSimdLevel()));
+  printf("%-18s %-5s %-7s %10s %12s\n","kernel","size","simd","GB/s","cycles/pix");
+
+  for(size_t c = 0;c < cases.size();++c)
+    {
+      for(int s = 0;s < nb_sizes;++s)
+	{
+	  const ImageSize& size = sizes[s];
+	  Job job = {&src[0],&dst[0],size.width,size.height,cases[c].kernel};
+	  double nb_bytes = cases[c].bytes(job);
+	  double nb_pixels = double(size.width) * size.height;
+
+	  for(int l = 0;l < Kernels::NbSimdLevel;++l)
+	    {
+	      Kernels::SimdLevel level = Kernels::SimdLevel(l);
+	      const Kernels::Table* table = Kernels::getTable(level);
+	      if(!table)
+		continue;
+	      if(!Kernels::isSupported(level))
+		{
+		  printf("%-18s %-5s %-7s %10s %12s\n",
+			 cases[c].name,size.name,
+			 Kernels::getSimdLevelName(level),"n/a","n/a");
+		  continue;
+		}
+	      cases[c].run(*table,job);		// warm-up
+
+	      int nb_iter = 0;
+	      double start = _now(),elapsed;
+	      unsigned long long start_cycles = _cycles();
+	      do
+		{
+		  cases[c].run(*table,job);
+		  ++nb_iter;
+		  elapsed = _now() - start;
+		}
+	      while(elapsed < min_time);
+	      unsigned long long cycles = _cycles() - start_cycles;
+
+	      printf("%-18s %-5s %-7s %10.2f %12.3f%s\n",
+		     cases[c].name,size.name,
+		     Kernels::getSimdLevelName(level),
+		     nb_bytes * nb_iter / elapsed / 1e9,
+		     cycles / (nb_pixels * nb_iter),
+		     level == Kernels::getSimdLevel() ? " *" : "");
+	    }
+	}
+    }
+  return 0;
+}
@@ -4,9 +4,13 @@ set(V4L2_DEFINITIONS)
 
 find_path(V4L2_INCLUDE_DIRS "libv4l2.h")
 find_library(V4L2_LIBRARIES v4l2)
+# frame decoding of the compressed recordings
+find_library(V4LCONVERT_LIBRARY v4lconvert)
+list(APPEND V4L2_LIBRARIES ${V4LCONVERT_LIBRARY})
 
 include(FindPackageHandleStandardArgs)
 find_package_handle_standard_args(V4L2 DEFAULT_MSG
   V4L2_LIBRARIES
+  V4LCONVERT_LIBRARY
   V4L2_INCLUDE_DIRS
 )
@@ -0,0 +1,86 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef V4L2CAPABILITYCACHE_H
+#define V4L2CAPABILITYCACHE_H
+#include "lima/Debug.h"
+#include <linux/videodev2.h>
+#include <string>
+#include <vector>
+#include "V4L2Controls.h"
+
+namespace lima
+{
+  namespace V4L2
+  {
+    /** On-disk cache of the device capabilities.
+     *
+     * The formats, the controls and the automatic exposure mode found by
+     * the first probe of a device are saved in a small text file, keyed
+     * by driver, card, bus info, driver version and USB firmware
+     * (bcdDevice) of the device. A later open only checks the key and the
+     * first format, the full probe is done again on any mismatch.
+     *
+     * The files are in $LIMA_V4L2_CACHE_DIR, by default
+     * $XDG_CACHE_HOME/lima-v4l2 (~/.cache/lima-v4l2); an empty
+     * LIMA_V4L2_CACHE_DIR disables the cache.
+     */
+    class CapabilityCache
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"CapabilityCache","V4L2");
+    public:
+      // 2: the control flags are saved as reported by the device
+      enum {Version = 2};
+
+      struct Data
+      {
+	std::vector<unsigned int>	formats;	// ENUM_FMT order
+	bool				time_per_frame;
+	int				autoexp_value;	// -1 if not supported
+	std::vector<Controls::Info>	controls;	// values not cached
+      };
+
+      /// queries the device capability and looks for a valid cache entry
+      CapabilityCache(int fd);
+
+      const struct v4l2_capability& getCapability() const { return m_cap; }
+      /// true if the data were read from the cache
+      bool isHit() const { return m_hit; }
+      /// the cached controls, NULL on a miss
+      const std::vector<Controls::Info>* getControls() const
+      { return m_hit ? &m_data.controls : NULL; }
+      Data& getData() { return m_data; }
+      /// write the probed data, never throws
+      void save();
+    private:
+      bool _load();
+      bool _checkFirstFormat();
+
+      int			m_fd;
+      struct v4l2_capability	m_cap;
+      std::string		m_key;
+      std::string		m_path;		// empty if disabled
+      bool			m_hit;
+      Data			m_data;
+    };
+  }
+}
+#endif
@@ -0,0 +1,103 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef V4L2CONTROLS_H
+#define V4L2CONTROLS_H
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+#include <linux/videodev2.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lima
+{
+  namespace V4L2
+  {
+    /** Cache of the device controls.
+     *
+     * Controls are enumerated once (VIDIOC_QUERY_EXT_CTRL) with their
+     * current value, and the cache is kept up to date with the
+     * V4L2_EVENT_CTRL events sent by the driver, so reading a value or
+     * a range doesn't reach the device. Writes go through
+     * VIDIOC_S_EXT_CTRLS, a group of values is applied atomically.
+     */
+    class Controls
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"Controls","V4L2");
+    public:
+      struct Info
+      {
+	unsigned int	id;
+	unsigned int	type;
+	std::string	name;
+	long long	minimum;
+	long long	maximum;
+	long long	step;
+	long long	default_value;
+	unsigned int	flags;
+	long long	value;
+      };
+      typedef std::map<unsigned int,long long> ValueMap;
+
+      /// infos: controls of a previous enumeration (CapabilityCache),
+      /// only their values are read from the device
+      Controls(int fd,const std::vector<Info>* infos = NULL);
+      ~Controls();
+
+      /// the enumerated controls, the values are the current ones
+      void getInfos(std::vector<Info>&);
+
+      bool isSupported(unsigned int id);
+      void getInfo(unsigned int id,Info&);
+      void getRange(unsigned int id,long long& min,long long& max);
+      bool isMenuItemSupported(unsigned int id,int index);
+
+      long long getValue(unsigned int id);
+      void setValue(unsigned int id,long long value);
+      /// all values are written with one VIDIOC_S_EXT_CTRLS,
+      /// on return they hold the values applied by the driver
+      void setValues(ValueMap& values);
+
+      /// apply the pending control events, never blocks
+      void processEvents();
+      /// switch to a reopened device, the previous fd is not used anymore
+      void setFd(int fd);
+      /** write the cached values back and subscribe the events again,
+       *  after the device was reopened (it restarts with its defaults)
+       */
+      void restore();
+    private:
+      typedef std::map<unsigned int,Info> InfoMap;
+
+      void _enumerate();
+      void _readValues();
+      void _subscribeEvents();
+      Info& _getInfo(unsigned int id);
+
+      int		m_fd;		// only used under m_mutex (setFd)
+      Mutex		m_mutex;
+      InfoMap		m_controls;
+      bool		m_events_supported;
+    };
+  }
+}
+#endif
@@ -0,0 +1,98 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef V4L2DISCOVERY_H
+#define V4L2DISCOVERY_H
+#include "lima/Debug.h"
+#include <string>
+#include <vector>
+
+namespace lima
+{
+  namespace V4L2
+  {
+    /** Discovery of the capture devices of the host.
+     *
+     * The /dev/video* nodes are opened concurrently, without libv4l2 so
+     * only the native formats are listed, and the nodes without video
+     * capture (e.g. UVC metadata nodes) are left out. Devices should be
+     * bound by bus_info (or by_path), the node numbers change with the
+     * plug order.
+     */
+    class Discovery
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"Discovery","V4L2");
+    public:
+      /// frame interval in seconds, min == max for a discrete one
+      struct Interval
+      {
+	double		min;
+	double		max;
+	double		step;
+      };
+
+      /// min == max for a discrete size, the intervals are the ones of
+      /// the max size
+      struct FrameSize
+      {
+	int			min_width;
+	int			min_height;
+	int			max_width;
+	int			max_height;
+	int			step_width;
+	int			step_height;
+	std::vector<Interval>	intervals;
+      };
+
+      struct Format
+      {
+	unsigned int		pixelformat;	// fourcc
+	std::string		description;
+	unsigned int		flags;		// V4L2_FMT_FLAG_*
+	std::vector<FrameSize>	sizes;
+      };
+
+      struct Device
+      {
+	std::string		path;		// /dev/videoN
+	std::string		by_path;	// /dev/v4l/by-path link, if any
+	std::string		driver;
+	std::string		card;
+	std::string		bus_info;
+	unsigned int		version;
+	std::string		error;		// set if the node can't be opened
+	std::vector<Format>	formats;
+      };
+
+      /** all the capture devices, ordered by node. nb_threads 0 opens
+       *  all the nodes at once (at most 32 threads); with_formats false
+       *  only queries the identification.
+       */
+      static void scan(std::vector<Device>& devices,int nb_threads = 0,
+		       bool with_formats = true);
+      /// node of the capture device on bus_info (or a by-path name)
+      static std::string findDevice(const std::string& bus_info);
+      /// companion metadata node (UVC payload headers) of the device on bus_info
+      static std::string findMetadataDevice(const std::string& bus_info);
+    };
+  }
+}
+#endif
@@ -0,0 +1,161 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef V4L2FRAMERING_H
+#define V4L2FRAMERING_H
+#include "lima/Debug.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace lima
+{
+  namespace V4L2
+  {
+    /** Frame ring in a named POSIX shared memory, for local readers in
+     *  other processes.
+     *
+     * The writer never waits for the readers: frame n goes to slot
+     * n % nb_slots, each slot is protected by a sequence counter (odd
+     * while written). A reader keeps its own cursor, reads the frame in
+     * place and checks on release that the slot was not overwritten
+     * meanwhile; a reader left behind by more than nb_slots frames skips
+     * to the oldest frame still in the ring.
+     *
+     * When a frame larger than the slots is published the ring is
+     * created again with larger slots, the generation of the old one is
+     * incremented so the readers open the new one, where the frame
+     * counts go on.
+     */
+    class FrameRing
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FrameRing","V4L2");
+    public:
+      enum {Version = 1,HeaderSize = 4096,SlotHeaderSize = 64};
+
+      struct Header
+      {
+	char		magic[8];	// "LIMARING"
+	uint32_t	version;
+	uint32_t	nb_slots;
+	uint64_t	slot_size;	// max frame bytes
+	uint64_t	slot_stride;	// slot header + data, 64 bytes aligned
+	uint32_t	generation;	// incremented when the ring is replaced
+	uint32_t	pad;
+	uint64_t	write_count;	// frames published
+      };
+
+      struct Slot
+      {
+	uint32_t	seq;		// odd while the frame is written
+	uint32_t	video_mode;	// lima VideoMode
+	uint64_t	count;		// publish number of the frame
+	int64_t		timestamp;	// capture time in ns
+	int32_t		frame_id;	// acquisition frame id
+	uint32_t	sequence;	// driver frame counter
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	size;		// bytes
+      };
+
+      FrameRing();
+      ~FrameRing();
+
+      /// name is a shm name ("/lima_v4l2"), the leading '/' is optional
+      void create(const std::string& name,int nb_slots,size_t slot_size);
+      void destroy();
+      bool isOpen() const { return m_header != NULL; }
+      const std::string& getName() const { return m_name; }
+
+      /** copy a frame to the next slot, the slot fields but seq and count
+       *  are taken from info. Never blocks, false if the ring can't grow.
+       */
+      bool publish(const unsigned char* data,const Slot& info);
+      long long getNbPublished() const;
+    private:
+      void _map(size_t slot_size,uint64_t write_count);
+      void _unmap();
+
+      std::string	m_name;
+      int		m_nb_slots;
+      uint32_t		m_generation;
+      Header*		m_header;
+      size_t		m_map_size;
+    };
+
+    /** reader side of FrameRing, one cursor per reader.
+     *
+     * The mappings of the replaced rings are kept until the reader is
+     * destroyed, so a frame pointer never dangles (its content is only
+     * guaranteed until release).
+     */
+    class FrameRingReader
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"FrameRingReader","V4L2");
+    public:
+      /// a frame in the ring, as seen by the bindings
+      struct Frame
+      {
+	const unsigned char*	data;
+	int			size;
+	long long		count;
+	long long		timestamp;	// ns
+	int			frame_id;
+	int			sequence;
+	int			width;
+	int			height;
+	int			video_mode;
+      };
+
+      FrameRingReader(const std::string& name);
+      ~FrameRingReader();
+
+      /** next frame after the cursor, false if none was published yet.
+       *  data stays in the ring, it is valid until release.
+       */
+      bool acquire(const unsigned char*& data,FrameRing::Slot& info);
+      /** same, waits up to timeout seconds for a new frame (the ring
+       *  has no notification, it is polled every 100 us).
+       */
+      bool acquire(Frame&,double timeout = 0.);
+      /// false if the frame was overwritten while it was in use
+      bool release();
+      /// move the cursor to the newest frame
+      void seekLatest();
+      /// frames overwritten before they were read
+      long long getNbLost() const { return m_nb_lost; }
+    private:
+      void _open();
+      void _close();
+
+      std::string		m_name;
+      FrameRing::Header*	m_header;
+      size_t			m_map_size;
+      uint32_t			m_generation;
+      uint64_t			m_cursor;
+      const FrameRing::Slot*	m_acquired;
+      uint32_t			m_acquired_seq;
+      long long			m_nb_lost;
+      std::vector<std::pair<void*,size_t> > m_retired;	// replaced rings
+    };
+  }
+}
+#endif
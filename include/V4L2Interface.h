@@ -23,6 +23,8 @@
 #define V4L2INTERFACE_H
 #include "lima/Debug.h"
 #include "lima/HwInterface.h"
+#include "V4L2MetadataStream.h"
+#include <vector>
 
 namespace lima
 {
@@ -31,6 +33,12 @@ namespace lima
     class DetInfoCtrlObj;
     class SyncCtrlObj;
     class VideoCtrlObj;
+
+    /// reference images of the dark and flat-field correction
+    enum Reference {NoReference,DarkReference,FlatReference};
+    /// what is done with a frame failing the capture checks
+    enum CorruptFramePolicy {DropCorruptFrame,RepeatLastFrame,MarkCorruptFrame};
+
     class Interface : public HwInterface
     {
       DEB_CLASS_NAMESPC(DebModCamera, "Interface", "V4L2");
@@ -47,8 +55,111 @@ namespace lima
       virtual void getStatus(StatusType& status);
       
       virtual int getNbHwAcquiredFrames();
+      bool waitNbHwAcquiredFrames(int nb_frames,double timeout = -1.);
+      bool waitAcqEnd(double timeout = -1.);
+
+      // --- image statistics (Y8 and Y16 only)
+      void setStatisticsActive(bool);
+      void getStatisticsActive(bool&);
+      void getLastImageStatistics(double& min,double& max,double& mean);
+
+      // --- exposure bracketing
+      void setExposureBracket(const std::vector<double>& exp_times);
+      void getExposureBracket(std::vector<double>& exp_times);
+      void setExposureLatency(int nb_frames);
+      void getExposureLatency(int& nb_frames);
+      void getFrameExpTime(int frame_id,double& exp_time);
+
+      // --- HDR merge of the bracketed frames
+      void setHdrActive(bool);
+      void getHdrActive(bool&);
+      void setHdrSaturation(int level);
+      void getHdrSaturation(int& level);
+
+      // --- frame accumulation
+      void setAccNbFrames(int nb_frames);
+      void getAccNbFrames(int& nb_frames);
+      void setAccAverage(bool);
+      void getAccAverage(bool&);
+
+      // --- dark and flat-field correction
+      void setCorrectionActive(bool);
+      void getCorrectionActive(bool&);
+      void setReferenceCapture(Reference);
+      void getReferenceCapture(Reference&);
+      void loadReference(Reference,const std::string& path);
+      void saveReference(Reference,const std::string& path);
+      void clearReference(Reference);
+
+      // --- buffers and live delivery
+      void setNbBuffers(int nb_buffers);
+      void getNbBuffers(int& nb_buffers);
+      void setKeepStreaming(bool);
+      void getKeepStreaming(bool&);
+      void getFirstFrameDelay(double& delay);
+      void setBufferPrefault(bool);
+      void getBufferPrefault(bool&);
+      void getModeSwitchTime(double& time);
+      void selectVideoMode(VideoMode mode,int min_width = 0,int min_height = 0,
+			   double min_fps = 0.);
+      void getFrameRate(double& fps);
+      void setDecodeRate(double pixels_per_second);
+      void getDecodeRate(double& pixels_per_second);
+      void setLiveLatestFrame(bool);
+      void getLiveLatestFrame(bool&);
+      void getDisplayLatency(double& latency);
+      void getNbSkippedFrames(int& nb_frames);
+      void setMaxBufferMemory(int mbytes);
+      void getMaxBufferMemory(int& mbytes);
+      void getNbStarvations(int& nb_starvations);
+      void getMinQueuedBuffers(int& nb_buffers);
+      void getNbDroppedFrames(int& nb_frames);
+      void setFrameTimeout(double timeout);
+      void getFrameTimeout(double& timeout);
+      void setReconnectTimeout(double timeout);
+      void getReconnectTimeout(double& timeout);
+      void getNbStreamRestarts(int& nb_restarts);
+      void getNbReconnects(int& nb_reconnects);
+      void getNbFrameErrors(int& nb_frames);
+      void setCorruptFramePolicy(CorruptFramePolicy);
+      void getCorruptFramePolicy(CorruptFramePolicy&);
+      void getNbCorruptFrames(int& nb_frames);
+      void getFrameCorrupt(int frame_id,bool& corrupt);
+
+      // --- UVC metadata (device clock)
+      void setMetadataActive(bool);
+      void getMetadataActive(bool&);
+      void getFrameMetadata(int frame_id,MetadataStream::Frame&);
+      void setDeviceClockFrequency(double frequency);
+      void getDeviceClockFrequency(double& frequency);
+
+      // --- decimated preview
+      void setPreviewActive(bool);
+      void getPreviewActive(bool&);
+      void setPreviewFactor(int factor);
+      void getPreviewFactor(int& factor);
+      void setPreviewMaxRate(double max_rate);
+      void getPreviewMaxRate(double& max_rate);
+      void getPreviewImage(int& frame_id,int& width,int& height,int& depth,
+			   std::vector<unsigned char>& data);
+
+      // --- raw recording
+      void startRecording(const std::string& path);
+      void stopRecording();
+      void getRecordingActive(bool&);
+      void getNbRecordedFrames(int& nb_frames);
+      void getNbRecordingStalls(int& nb_stalls);
+      void setRecordingCompressed(bool);
+      void getRecordingCompressed(bool&);
+      void setRecordingLiveRate(double rate);
+      void getRecordingLiveRate(double& rate);
+
+      // --- shared memory frame ring
+      void startFrameRing(const std::string& name,int nb_slots = 16);
+      void stopFrameRing();
+      void getFrameRingActive(bool&);
+      void getNbPublishedFrames(int& nb_frames);
     private:
-      int 			m_fd;
       DetInfoCtrlObj* 		m_det_info;
       SyncCtrlObj*		m_sync;
       CapList 	                m_cap_list;
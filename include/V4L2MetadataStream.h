@@ -0,0 +1,99 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef V4L2METADATASTREAM_H
+#define V4L2METADATASTREAM_H
+#include "lima/Debug.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace lima
+{
+  namespace V4L2
+  {
+    /** UVC metadata capture node (V4L2_META_FMT_UVC), streamed along
+     *  with the video node of the same camera.
+     *
+     * uvcvideo completes the metadata buffer of a frame just before its
+     * video buffer, with the same sequence: the buffers are matched by
+     * sequence when the video frame is dequeued. A metadata buffer holds
+     * the UVC payload headers of the frame (host time, PTS, SCR).
+     */
+    class MetadataStream
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"MetadataStream","V4L2");
+    public:
+      /// device clock of a frame
+      struct Frame
+      {
+	int		frame_id;	// -1 if no metadata matched the frame
+	uint32_t	sequence;	// driver frame counter
+	int64_t		host_time;	// ns (CLOCK_MONOTONIC), first packet
+	int		host_sof;	// host USB frame number at host_time
+	bool		has_pts;
+	uint32_t	pts;		// device clock at the start of exposure
+	bool		has_scr;
+	uint32_t	scr_stc;	// device clock when the first packet was sent
+	int		scr_sof;	// device USB frame number at scr_stc
+	double		device_time;	// s, unwrapped pts, -1 if unknown
+      };
+
+      MetadataStream();
+      ~MetadataStream();
+
+      void open(const std::string& path,int nb_buffers);
+      void close();
+      bool isOpen() const { return m_fd >= 0; }
+      const std::string& getPath() const { return m_path; }
+
+      /// queue all buffers and start, before the video stream
+      void start();
+      void stop();
+
+      /** the metadata of the video frame of this sequence, the older
+       *  buffers are given back to the driver. Never blocks.
+       */
+      bool getFrame(uint32_t sequence,Frame&);
+
+      /// Hz, read from the UVC descriptors, 0 if unknown
+      void setClockFrequency(double frequency) { m_clock_frequency = frequency; }
+      double getClockFrequency() const { return m_clock_frequency; }
+    private:
+      bool _queue(int index);
+      void _parse(int index,unsigned int size,Frame&);
+      static double _readClockFrequency(const std::string& path);
+
+      std::string		m_path;
+      int			m_fd;
+      std::vector<void*>	m_buffers;
+      size_t			m_length;
+      bool			m_streaming;
+      int			m_pending;	// dequeued ahead of the video
+      uint32_t			m_pending_sequence;
+      unsigned int		m_pending_size;
+      double			m_clock_frequency;
+      int64_t			m_pts_base;	// pts unwrapping
+      uint32_t			m_last_pts;
+    };
+  }
+}
+#endif
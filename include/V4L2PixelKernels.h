@@ -0,0 +1,146 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef V4L2PIXELKERNELS_H
+#define V4L2PIXELKERNELS_H
+
+namespace lima
+{
+  namespace V4L2
+  {
+    /** Per-frame pixel kernels (format conversion, crop, binning,
+     *  statistics, HDR merge, accumulation and flat-field correction).
+     *
+     * Each kernel is compiled once per SIMD level (see CMakeLists.txt),
+     * the level is chosen from the cpu features when the kernels are
+     * first used and can be lowered with the LIMA_V4L2_SIMD_LEVEL
+     * environment variable (scalar, sse2, avx2 or avx512).
+     * bench/V4L2KernelBench.cpp measures all of them.
+     */
+    namespace Kernels
+    {
+      enum SimdLevel {Scalar,SSE2,AVX2,AVX512,NbSimdLevel};
+
+      enum Kernel {YUYV_2_Y8,		// packed YUV 4:2:2 -> luminance
+		   UYVY_2_Y8,
+		   RGB24_2_Y8,		// ITU-R BT.601 luma
+		   BAYER_BG8_2_RGB24,	// 2x2 super-pixel demosaicing
+		   PACKED10_2_Y16,	// MIPI RAW10 (V4L2_PIX_FMT_Y10P)
+		   NbKernel};
+
+      enum PixelType {Pixel8,Pixel16,NbPixelType};
+
+      struct CpuFeatures
+      {
+	bool sse2;
+	bool avx2;		// AVX2 + FMA, including OS support of the ymm state
+	bool avx512;		// AVX512F/BW/VL + avx2, including zmm state
+      };
+
+      struct Statistics
+      {
+	double min;
+	double max;
+	double mean;
+      };
+
+      /** src_stride is the source line length in bytes (bytesperline),
+       *  destination lines are packed.
+       */
+      typedef void (*ConvFunc)(const unsigned char* src,int src_stride,
+			       unsigned char* dst,int width,int height);
+      /// copy height lines of line_size bytes
+      typedef void (*CropFunc)(const unsigned char* src,int src_stride,
+			       unsigned char* dst,int line_size,int height);
+      /** average bin_x * bin_y source pixels,
+       *  width and height are the destination (binned) size.
+       */
+      typedef void (*BinFunc)(const unsigned char* src,int src_stride,
+			      unsigned char* dst,int width,int height,
+			      int bin_x,int bin_y);
+      typedef void (*StatFunc)(const unsigned char* src,int width,int height,
+			       Statistics&);
+      /** add one frame taken with exp_time to the HDR sums: pixels at or
+       *  above saturation are masked, the others are weighted by their
+       *  distance to the ends of the range (sum += w * v / exp_time,
+       *  weight += w).
+       */
+      typedef void (*HdrAccFunc)(const unsigned char* src,int nb_pixels,
+				 float exp_time,float saturation,
+				 float* sum,float* weight);
+      /** dst = sum / weight * scale, fallback where all the frames were
+       *  saturated. dst is 32 bits and clipped to 2^31.
+       */
+      typedef void (*HdrMergeFunc)(const float* sum,const float* weight,
+				   int nb_pixels,float scale,float fallback,
+				   unsigned int* dst);
+
+      /// acc += src
+      typedef void (*AccFunc)(const unsigned char* src,int nb_pixels,
+			      unsigned int* acc);
+      /// dst = acc / nb_frames rounded to nearest, acc must be below 2^31
+      typedef void (*AvgFunc)(const unsigned int* acc,int nb_pixels,
+			      int nb_frames,unsigned char* dst);
+
+      /// dst = (src - dark) * gain, rounded and clipped to 16 bits
+      typedef void (*FlatFieldFunc)(const unsigned char* src,int nb_pixels,
+				    const float* dark,const float* gain,
+				    unsigned short* dst);
+
+      struct Table
+      {
+	ConvFunc conv[NbKernel];
+	CropFunc crop;
+	BinFunc bin[NbPixelType];
+	BinFunc bin2x2[NbPixelType];	// bin_x and bin_y ignored
+	BinFunc bin4x4[NbPixelType];
+	StatFunc stat[NbPixelType];
+	HdrAccFunc hdr_acc[NbPixelType];
+	HdrMergeFunc hdr_merge;
+	AccFunc acc[NbPixelType];
+	AvgFunc avg[NbPixelType];
+	FlatFieldFunc flat_field[NbPixelType];
+      };
+
+      const char* getSimdLevelName(SimdLevel);
+      const char* getKernelName(Kernel);
+
+      /// minimum source line length in bytes for a given width
+      int getSrcLineSize(Kernel,int width);
+      /// destination pixel depth in bytes
+      int getDstPixelDepth(Kernel);
+
+      const CpuFeatures& getCpuFeatures();
+      /// NULL if this level was not compiled in
+      const Table* getTable(SimdLevel);
+      bool isSupported(SimdLevel);
+      SimdLevel getBestSimdLevel();
+
+      /// level and kernels selected on the first call
+      SimdLevel getSimdLevel();
+      const Table& getKernels();
+      ConvFunc getConvFunc(Kernel);
+      /// the specialization for this binning if there is one
+      BinFunc getBinFunc(PixelType,int bin_x,int bin_y);
+    }
+  }
+}
+#endif
@@ -0,0 +1,151 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef V4L2RECORDER_H
+#define V4L2RECORDER_H
+#include "lima/Debug.h"
+#include "lima/ThreadUtils.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct v4lconvert_data;
+
+namespace lima
+{
+  namespace V4L2
+  {
+    /** Raw stream recorder.
+     *
+     * The frames are copied from the capture buffers into two aligned
+     * chunks: while one is filled, the other is written by a thread with
+     * large O_DIRECT writes, so the page cache is bypassed and the
+     * capture only waits when the disk is slower than the stream.
+     *
+     * File layout (host byte order): a HeaderSize bytes header, the
+     * frames packed one after the other (each one is its FrameEntry
+     * followed by its payload), then the frame index (the FrameEntry of
+     * every frame) at an aligned offset, written on close. A file left
+     * without index (crash) is read by scanning the frames.
+     */
+    class Recorder
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"Recorder","V4L2");
+    public:
+      enum {HeaderSize = 4096,Version = 1};
+
+      struct Header
+      {
+	char		magic[8];	// "LIMAV4L2"
+	uint32_t	version;
+	uint32_t	header_size;
+	uint64_t	nb_frames;
+	uint64_t	index_offset;	// 0 until the file is closed
+      };
+
+      struct FrameEntry
+      {
+	uint64_t	offset;		// from the start of the file
+	uint32_t	size;		// payload bytes (bytesused)
+	uint32_t	sequence;	// driver frame counter
+	int64_t		timestamp;	// capture time in ns
+	uint32_t	pixelformat;	// V4L2 fourcc
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	bytesperline;
+      };
+
+      Recorder();
+      ~Recorder();
+
+      /// chunk_size is rounded up to the alignment
+      void open(const std::string& path,int chunk_size = 8 << 20);
+      /// flush the data, write the index and the header
+      void close();
+      bool isOpen() const { return m_fd >= 0; }
+
+      /** append a frame, the offset of the entry is set here.
+       *  Never throws (called by the acquisition thread), on a write
+       *  error the frame is dropped and false is returned.
+       */
+      bool addFrame(const unsigned char* data,FrameEntry& entry);
+
+      int getNbFrames();
+      long long getNbBytes();
+      /// times the capture waited for the disk
+      int getNbStalls();
+    private:
+      class _WriteThread;
+      friend class _WriteThread;
+
+      void _append(const unsigned char* data,size_t size);
+      void _swapChunks();
+      void _waitWrite();
+
+      std::string		m_path;
+      int			m_fd;
+      Cond			m_cond;
+      _WriteThread*		m_thread;
+      bool			m_quit;
+      unsigned char*		m_chunks[2];
+      size_t			m_chunk_size;
+      int			m_fill_chunk;
+      size_t			m_fill_size;
+      uint64_t			m_file_offset;	// of the chunk being filled
+      uint64_t			m_data_size;
+      int			m_write_chunk;	// -1 if the thread is idle
+      size_t			m_write_size;
+      uint64_t			m_write_offset;
+      int			m_write_error;	// errno of the last failed write
+      int			m_nb_stalls;
+      std::vector<FrameEntry>	m_index;
+    };
+
+    /** Read a file written by Recorder, the file is memory mapped and
+     *  the frames are read in place.
+     */
+    class RecordReader
+    {
+      DEB_CLASS_NAMESPC(DebModCamera,"RecordReader","V4L2");
+    public:
+      RecordReader(const std::string& path);
+      ~RecordReader();
+
+      int getNbFrames() const { return m_nb_frames; }
+      const Recorder::FrameEntry& getFrameEntry(int frame_nb) const;
+      const unsigned char* getFrameData(int frame_nb) const;
+      /** decode a frame to RGB24 (width * height * 3 bytes), compressed
+       *  (MJPEG/JPEG) recordings are only decoded here.
+       */
+      void decodeFrame(int frame_nb,std::vector<unsigned char>& rgb);
+    private:
+      void _scanFrames(uint64_t offset);
+
+      unsigned char*			m_base;
+      size_t				m_size;
+      int				m_nb_frames;
+      const Recorder::FrameEntry*	m_index;
+      std::vector<Recorder::FrameEntry>	m_scanned_index;	// file without index
+      struct v4lconvert_data*		m_decoder;
+    };
+  }
+}
+#endif
@@ -28,7 +28,18 @@
 #include "lima/Constants.h"
 #include <linux/videodev2.h>
 #include <libv4l2.h>
+#include <libv4lconvert.h>
 #include <set>
+#include <map>
+#include <vector>
+#include <list>
+#include "V4L2PixelKernels.h"
+#include "V4L2Controls.h"
+#include "V4L2CapabilityCache.h"
+#include "V4L2Interface.h"
+#include "V4L2Recorder.h"
+#include "V4L2FrameRing.h"
+#include "V4L2MetadataStream.h"
 
 namespace lima
 {
@@ -58,8 +69,8 @@ namespace lima
       virtual void checkBin(Bin& bin);
       virtual void checkRoi(const Roi& set_roi,Roi& hw_roi);
       
-      virtual void setBin(const Bin&){};
-      virtual void setRoi(const Roi&){};
+      virtual void setBin(const Bin&);
+      virtual void setRoi(const Roi&);
 
      // --- Detector Info
       void getMaxImageSize(Size&);
@@ -76,6 +87,169 @@ namespace lima
       void setNbHwFrames(int  nb_frames);
       void getNbHwFrames(int& nb_frames);
 
+      /** IntTrig or IntTrigMult, in IntTrigMult the stream runs from
+       *  prepareAcq and each startAcq delivers the next frame exposed
+       *  after it.
+       */
+      void setTrigMode(TrigMode);
+      void getTrigMode(TrigMode&) const;
+
+      /// number of mmap buffers of the stream (2 by default)
+      void setNbBuffers(int nb_buffers);
+      void getNbBuffers(int& nb_buffers) const;
+      /** leave the stream running between acquisitions, the next one
+       *  starts on the already queued buffers (frames exposed before
+       *  startAcq are dropped).
+       */
+      void setKeepStreaming(bool);
+      void getKeepStreaming(bool&) const;
+      /// time from prepareAcq to the first image of the last acquisition
+      void getFirstFrameDelay(double& delay);
+      /** fault in the pages of the capture buffers when they are mapped
+       *  (and now), instead of at the first capture. Off by default.
+       */
+      void setBufferPrefault(bool);
+      void getBufferPrefault(bool&) const;
+      /// duration of the last setVideoMode
+      void getModeSwitchTime(double& time) const;
+      /** set mode from the device format, frame size and interval with
+       *  the highest delivered pixel rate, of at least min_width x
+       *  min_height and min_fps (the best frame rate if none reaches it)
+       */
+      void selectVideoMode(VideoMode mode,int min_width = 0,int min_height = 0,
+			   double min_fps = 0.);
+      /// frame rate set in the device (0 if it doesn't tell)
+      void getFrameRate(double& fps);
+      /** pixels per second libv4l2 can decode (MJPEG...), caps the rate
+       *  of the decoded formats in selectVideoMode. 150e6 by default.
+       */
+      void setDecodeRate(double pixels_per_second);
+      void getDecodeRate(double& pixels_per_second) const;
+      /** in live mode, always hand the newest captured frame to Lima,
+       *  older waiting buffers are requeued without being processed.
+       */
+      void setLiveLatestFrame(bool);
+      void getLiveLatestFrame(bool&) const;
+      /// delay between the capture and the delivery of the last frame
+      void getDisplayLatency(double& latency);
+      /// frames skipped by the latest frame policy since the live start
+      void getNbSkippedFrames(int& nb_frames);
+      /** grow the buffer ring with VIDIOC_CREATE_BUFS when the driver
+       *  runs out of queued buffers during an acquisition, up to mbytes
+       *  of buffers. 0 (default) disables the growth.
+       */
+      void setMaxBufferMemory(int mbytes);
+      void getMaxBufferMemory(int& mbytes) const;
+      /// times the driver had no queued buffer left, since prepareAcq
+      void getNbStarvations(int& nb_starvations);
+      /// fewest buffers left in the driver at a dequeue, since prepareAcq
+      void getMinQueuedBuffers(int& nb_buffers);
+      /// gaps of the driver frame sequence, since prepareAcq
+      void getNbDroppedFrames(int& nb_frames);
+      /** restart the stream when no frame comes within timeout seconds,
+       *  0 (default) is 5 frame intervals or exposures (at least 1 s),
+       *  negative waits forever
+       */
+      void setFrameTimeout(double timeout);
+      void getFrameTimeout(double& timeout) const;
+      /** how long a disconnected device is waited for to be reopened,
+       *  10 s by default, 0 ends the acquisition at once
+       */
+      void setReconnectTimeout(double timeout);
+      void getReconnectTimeout(double& timeout) const;
+      /// recoveries since prepareAcq
+      void getNbStreamRestarts(int& nb_restarts);
+      void getNbReconnects(int& nb_reconnects);
+      /// frames dequeued with V4L2_BUF_FLAG_ERROR, since prepareAcq
+      void getNbFrameErrors(int& nb_frames);
+      /** frames with the error flag, a truncated payload or a broken JPEG
+       *  are dropped (default), replaced by the last good image (only
+       *  without HDR nor accumulation) or delivered and marked
+       */
+      void setCorruptFramePolicy(CorruptFramePolicy);
+      void getCorruptFramePolicy(CorruptFramePolicy&) const;
+      /// frames failing the checks, since prepareAcq
+      void getNbCorruptFrames(int& nb_frames);
+      /// true if the frame was marked or repeated, for the recent frames
+      void getFrameCorrupt(int frame_id,bool& corrupt);
+
+      /** accumulate nb_frames consecutive Y8/Y16 frames and deliver only
+       *  their sum (Y32) or their average (same depth), 1 disables it.
+       */
+      void setAccNbFrames(int nb_frames);
+      void getAccNbFrames(int& nb_frames) const;
+      void setAccAverage(bool);
+      void getAccAverage(bool&) const;
+
+      /** dark and flat-field correction of the delivered Y8/Y16 images:
+       *  (raw - dark) * mean(flat - dark) / (flat - dark), in Y16.
+       */
+      void setCorrectionActive(bool);
+      void getCorrectionActive(bool&) const;
+      /** while set, the processed frames of the acquisitions are averaged
+       *  into this reference, which is stored when the capture is set
+       *  back to NoReference.
+       */
+      void setReferenceCapture(Reference);
+      void getReferenceCapture(Reference&) const;
+      /// raw native float32 or uint16 file, of the processed frame size
+      void loadReference(Reference,const std::string& path);
+      /// raw native float32 file
+      void saveReference(Reference,const std::string& path);
+      void clearReference(Reference);
+
+      /** decimated preview of the Y8/Y16 frames for remote viewers,
+       *  factor x factor pixels are averaged (box filter), at most
+       *  max_rate previews per second (0 for every frame).
+       */
+      void setPreviewActive(bool);
+      void getPreviewActive(bool&) const;
+      void setPreviewFactor(int factor);
+      void getPreviewFactor(int& factor) const;
+      void setPreviewMaxRate(double max_rate);
+      void getPreviewMaxRate(double& max_rate) const;
+      /// copy of the last preview, depth is the pixel size in bytes
+      void getPreviewImage(int& frame_id,int& width,int& height,int& depth,
+			   std::vector<unsigned char>& data);
+
+      /** record the captured frames, as delivered by the driver, to a raw
+       *  file (see Recorder) until stopRecording.
+       */
+      void startRecording(const std::string& path);
+      void stopRecording();
+      void getRecordingActive(bool&);
+      void getNbRecordedFrames(int& nb_frames);
+      /// times the capture waited for the disk
+      void getNbRecordingStalls(int& nb_stalls);
+      /** store the compressed frames of MJPEG/JPEG cameras as-is: while
+       *  recording, the device streams its native compressed format and
+       *  a frame is only decoded when it is handed to Lima.
+       */
+      void setRecordingCompressed(bool);
+      void getRecordingCompressed(bool&) const;
+      /// frames decoded per second in live mode (0 for every frame)
+      void setRecordingLiveRate(double rate);
+      void getRecordingLiveRate(double& rate) const;
+
+      /** publish the images handed to Lima in a named POSIX shared
+       *  memory ring (see FrameRing) for readers in other processes.
+       */
+      void startFrameRing(const std::string& name,int nb_slots = 16);
+      void stopFrameRing();
+      void getFrameRingActive(bool&);
+      void getNbPublishedFrames(int& nb_frames);
+
+      /** stream the UVC metadata node of the camera with the video,
+       *  each frame gets the device clock of its payload headers
+       */
+      void setMetadataActive(bool);
+      void getMetadataActive(bool&) const;
+      /// for the recent frames
+      void getFrameMetadata(int frame_id,MetadataStream::Frame&);
+      /// device clock (PTS) frequency in Hz, from the UVC descriptors
+      void setDeviceClockFrequency(double frequency);
+      void getDeviceClockFrequency(double& frequency) const;
+
       // --- Acquisition interface
       void reset(HwInterface::ResetLevel reset_level);
       void prepareAcq();
@@ -83,22 +257,148 @@ namespace lima
       void stopAcq();
       void getStatus(HwInterface::StatusType& status);
       int getNbHwAcquiredFrames();
+      /** block until nb_frames images are acquired, false on timeout
+       *  (seconds, negative waits forever) or if the acquisition ends first
+       */
+      bool waitNbHwAcquiredFrames(int nb_frames,double timeout = -1.);
+      /** block until the acquisition thread is idle, false on timeout.
+       *  In IntTrigMult, until the pending triggers are served (the
+       *  stream stays armed until stopAcq), like the Ready status.
+       */
+      bool waitAcqEnd(double timeout = -1.);
       int getV4l2Fd() { return m_fd; }
       
       // others
       bool isAutoExposureSupported();
+      void setAutoExposure(bool);
+      Controls& getControls() { return m_controls; }
+
+      void setStatisticsActive(bool);
+      void getStatisticsActive(bool&) const;
+      void getLastImageStatistics(double& min,double& max,double& mean);
+
+      /** exposure bracketing: the exposure times (in seconds) are cycled
+       *  frame by frame during the acquisition, an empty list disables it.
+       */
+      void setExposureBracket(const std::vector<double>& exp_times);
+      void getExposureBracket(std::vector<double>& exp_times) const;
+      /// frames between an exposure write and the first frame it applies to
+      void setExposureLatency(int nb_frames);
+      void getExposureLatency(int& nb_frames) const;
+      /// exposure time the frame was taken with, for the recent frames
+      void getFrameExpTime(int frame_id,double& exp_time);
+
+      /** merge each group of bracketed frames into one Y32 image,
+       *  expressed in counts of the longest exposure.
+       */
+      void setHdrActive(bool);
+      void getHdrActive(bool&) const;
+      /// first saturated pixel value, 0 is the full scale of the video mode
+      void setHdrSaturation(int level);
+      void getHdrSaturation(int& level) const;
 
     private:
       class _AcqThread;
       friend class _AcqThread;
       void _unmap();
       void _map();
+      void _setFormat(VideoMode,int emulated_index,struct v4l2_format&,bool changed);
+      void _prepareFramePath();
+      /// conversion, binning/roi and statistics, width and height are set
+      unsigned char* _processImage(unsigned char* data,int& width,int& height);
+      void _prepareExposure();
+      void _updateExposure(int frame_id);
+      void _restartExposure();
+      unsigned char* _mergeHdr(unsigned char* data,int width,int height);
+      void _extendCapture(int nb_frames);
+      unsigned char* _accumulate(unsigned char* data,int width,int height);
+      unsigned char* _correct(unsigned char* data,int width,int height);
+      void _captureReference(const unsigned char* data,int width,int height);
+      void _endReferenceCapture();
+      void _prepareCorrection();
+      /// size of the frames after binning and roi
+      void _getProcessedSize(Size&);
+      /// captured frames per delivered image (HDR group, accumulation)
+      int _getNbFramesPerImage() const;
+      bool _isY32Output() const
+      { return m_hdr_active || (m_acc_nb_frames > 1 && !m_acc_average); }
+      bool _isTrigMult() const { return m_trig_mode == IntTrigMult && !m_live; }
+      bool _acceptFrame();
+      void _dequeueLatest();
+      void _checkStarvation();
+      void _growBuffers();
+      bool _recover(int error);
+      bool _restartStream();
+      bool _checkFrame();
+      bool _repeatLastFrame();
+      void _matchMetadata();
+      void _updateMetadata(int frame_id);
+      void _reopenMetadata();
+      bool _reopen();
+      void _closeRetiredFds();
+      bool _queueBuffer(struct v4l2_buffer&);
+      void _prefault(void* p,size_t length);
+      bool _isAcqEnded() const;
+      bool _waitCond(double& timeout);
+      void _streamOn();
+      void _streamOff();
+      void _flushStream();
+      void _updateFirstFrameDelay();
+      void _updateLatency();
+      void _updatePreview(const unsigned char* data,int width,int height);
+      void _record();
+      void _startCompressedStream();
+      void _stopCompressedStream();
+      /// format of the frames handed to Lima (decoded if compressed)
+      void _getFormat(struct v4l2_format&) const;
+      /** decode the dequeued frame, NULL if it is only recorded or if
+       *  it can't be decoded (corrupt is then set)
+       */
+      unsigned char* _decode(bool& corrupt);
+      void _publish(const unsigned char* data,int width,int height,VideoMode);
+
+      struct _ExpTag
+      {
+	int	frame_id;
+	double	exp_time;
+	bool	corrupt;	// MarkCorruptFrame, or repeated
+      };
+
+      // per frame processing, resolved by prepareAcq
+      struct _FramePath
+      {
+	VideoMode		mode;		// handed to Lima
+	int			width;		// of the (converted) frame
+	int			height;
+	int			stride;		// source line length in bytes
+	int			depth;		// pixel bytes, 0 if not processed
+	size_t			offset;		// of the roi in the source
+	int			out_width;
+	int			out_height;
+	Kernels::ConvFunc	conv;
+	Kernels::CropFunc	crop;		// roi without binning
+	Kernels::BinFunc	bin;
+	Kernels::StatFunc	stat;
+      };
 
       std::string 		m_det_model;
       int 			m_fd;
+      CapabilityCache		m_capabilities;
+      Controls			m_controls;
       struct v4l2_buffer 	m_buffer;
-      unsigned char* 		m_buffers[2];
+      std::vector<unsigned char*> m_buffers;
+      int                       m_nb_buffers;	// requested
+      std::vector<bool>         m_buffer_queued;	// owned by the driver
+      bool                      m_streaming;
+      bool                      m_keep_streaming;
+      double                    m_start_time;	// of a reused stream, -1 else
+      double                    m_prepare_time;
+      double                    m_first_frame_delay;
+      bool                      m_buffer_prefault;
+      double                    m_mode_switch_time;
+      double                    m_decode_rate;	// libv4l2 pixels per second
       int 			m_nb_frames;
+      int 			m_nb_capture_frames;
       int 			m_acq_frame_id;
       bool 			m_acq_started;
       bool			m_acq_thread_run;
@@ -108,9 +408,132 @@ namespace lima
       bool			m_quit;
       Cond			m_cond;
       bool                      m_live;
+      // software triggers (IntTrigMult)
+      TrigMode                  m_trig_mode;
+      int                       m_nb_triggers;	// pending
+      int                       m_trig_skip;
+      double                    m_trig_time;
+      double                    m_last_timestamp;
+      // latest frame live policy
+      bool                      m_live_latest;
+      int                       m_nb_skipped_frames;
+      double                    m_display_latency;
+      // buffer starvation
+      int                       m_max_buffer_memory;	// MB, 0: no growth
+      bool                      m_buffer_growth;	// resolved by prepareAcq
+      int                       m_nb_starvations;
+      int                       m_min_queued;
+      int                       m_nb_dropped_frames;
+      long long                 m_last_sequence;
+      // stream recovery
+      std::string               m_dev_path;
+      std::string               m_bus_info;
+      std::vector<int>          m_retired_fds;	// replaced by _reopen
+      double                    m_frame_timeout;	// 0: from the frame interval
+      double                    m_reconnect_timeout;
+      int                       m_poll_timeout;	// ms, resolved by prepareAcq
+      struct v4l2_format        m_acq_format;	// restored on reopen
+      struct v4l2_streamparm    m_acq_parm;
+      int                       m_nb_failures;	// in a row
+      int                       m_nb_stream_restarts;
+      int                       m_nb_reconnects;
+      int                       m_nb_frame_errors;
+      bool                      m_acq_error;
+      // corrupt frames
+      CorruptFramePolicy        m_corrupt_policy;
+      int                       m_nb_corrupt_frames;
+      std::vector<unsigned char> m_last_good;	// RepeatLastFrame
+      int                       m_last_good_width;
+      int                       m_last_good_height;
+      VideoMode                 m_last_good_mode;
       double                    m_gain;
       bool                      m_autoexp_supported;
       bool                      m_exptime_supported;
+      int                       m_autoexp_value;
+      double                    m_exp_time;	// last requested
+      // video modes only reachable through a software conversion
+      std::map<VideoMode,int>   m_emulated_format;
+      Kernels::ConvFunc         m_conv_func;
+      VideoMode                 m_conv_mode;
+      int                       m_conv_src_stride;
+      std::vector<unsigned char> m_conv_buffer;
+      int                       m_bytes_per_line;
+      // software binning, roi and statistics (Y8 and Y16 only)
+      Kernels::PixelType        m_pixel_type;
+      int                       m_pixel_max;	// full scale of Y8/Y16
+      Bin                       m_bin;
+      Roi                       m_roi;
+      std::vector<unsigned char> m_proc_buffer;
+      _FramePath                m_path;
+      bool                      m_stat_active;
+      Kernels::Statistics       m_last_stat;
+      // exposure bracketing and per frame exposure tags
+      std::vector<double>       m_exp_bracket;
+      int                       m_exp_latency;
+      std::list<std::pair<int,double> > m_exp_pending; // first frame,exp_time
+      double                    m_frame_exp_time;
+      int                       m_exp_sequence_origin;	// of bracket[0]
+      std::vector<_ExpTag>      m_exp_tags;	// ring, indexed by frame id
+      // HDR merge of the bracket groups
+      bool                      m_hdr_active;
+      int                       m_hdr_saturation;
+      int                       m_hdr_nb_frames;	// in the current group
+      int                       m_hdr_nb_images;	// merged since prepareAcq
+      double                    m_hdr_min_exp_time;
+      double                    m_hdr_max_exp_time;
+      std::vector<float>        m_hdr_sum;
+      std::vector<float>        m_hdr_weight;
+      std::vector<unsigned int> m_hdr_image;
+      // frame accumulation
+      int                       m_acc_nb_frames;
+      bool                      m_acc_average;
+      int                       m_acc_count;	// in the current sum
+      std::vector<unsigned int> m_acc_buffer;
+      std::vector<unsigned char> m_acc_image;
+      // dark and flat-field correction
+      struct _Reference
+      {
+	int			width;
+	int			height;
+	std::vector<float>	data;
+      };
+      _Reference                m_refs[3];	// indexed by Reference
+      Reference                 m_ref_capture;
+      int                       m_ref_count;
+      int                       m_ref_width;
+      int                       m_ref_height;
+      std::vector<unsigned int> m_ref_acc;
+      bool                      m_corr_active;
+      std::vector<float>        m_corr_dark;
+      std::vector<float>        m_corr_gain;
+      std::vector<unsigned short> m_corr_image;
+      // decimated preview
+      bool                      m_preview_active;
+      int                       m_preview_factor;
+      double                    m_preview_max_rate;
+      double                    m_preview_time;	// of the last preview
+      int                       m_preview_frame_id;
+      int                       m_preview_width;
+      int                       m_preview_height;
+      std::vector<unsigned char> m_preview_buffer;
+      // raw recording
+      Recorder                  m_recorder;
+      struct v4l2_pix_format    m_rec_format;
+      bool                      m_rec_compressed;
+      double                    m_rec_live_rate;
+      double                    m_rec_live_time;	// of the last decoded frame
+      bool                      m_stream_compressed;
+      struct v4l2_format        m_stream_format;	// native compressed
+      struct v4l2_format        m_decode_format;
+      struct v4lconvert_data*   m_decoder;
+      std::vector<unsigned char> m_decode_buffer;
+      // shared memory ring
+      FrameRing                 m_ring;
+      // UVC metadata
+      MetadataStream            m_metadata;
+      std::vector<MetadataStream::Frame> m_frame_metadata;	// ring, by frame id
+      MetadataStream::Frame     m_metadata_frame;	// of the dequeued buffer
+      bool                      m_metadata_found;
    };
   }
 }
@@ -22,3 +22,23 @@
 from Lima import Core
 from limav4l2 import V4L2 as _V4l2
 globals().update(_V4l2.__dict__)
+
+def frame_array(frame):
+    """Numpy view (no copy) of a FrameRingReader frame, valid until
+    the frame is released."""
+    import numpy
+    mode = frame.video_mode
+    shape = (frame.height, frame.width)
+    if mode == Core.Y8:
+        dtype = numpy.uint8
+    elif mode == Core.Y16:
+        dtype = numpy.uint16
+    elif mode == Core.Y32:
+        dtype = numpy.uint32
+    elif mode in (Core.RGB24, Core.BGR24):
+        dtype, shape = numpy.uint8, shape + (3,)
+    elif mode in (Core.RGB32, Core.BGR32):
+        dtype, shape = numpy.uint8, shape + (4,)
+    else:
+        return numpy.frombuffer(frame, dtype=numpy.uint8)
+    return numpy.frombuffer(frame, dtype=dtype).reshape(shape)
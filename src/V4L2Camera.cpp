@@ -247,7 +247,6 @@ Camera::Camera(Camera::Callback* cbk,const char* video_device):
       if (p == MAP_FAILED) 
 	THROW_HW_ERROR(Error) << "mapping buffer " 
 			      << i << ": " << strerror(errno);
-      memset(p, 0, m_buffer.length);
       m_buffers[i] = (unsigned char *)p;
     }
 
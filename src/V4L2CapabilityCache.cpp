@@ -0,0 +1,232 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <libv4l2.h>
+#include "lima/Exceptions.h"
+#include "V4L2CapabilityCache.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+static const char CACHE_MAGIC[] = "LIMAV4L2CAPS";
+
+static std::string _cache_dir()
+{
+  const char* dir = getenv("LIMA_V4L2_CACHE_DIR");
+  if(dir)
+    return dir;
+  const char* xdg = getenv("XDG_CACHE_HOME");
+  if(xdg && *xdg)
+    return std::string(xdg) + "/lima-v4l2";
+  const char* home = getenv("HOME");
+  if(home && *home)
+    return std::string(home) + "/.cache/lima-v4l2";
+  return "";
+}
+
+// firmware revision of USB devices, empty for the others
+static std::string _firmware(int fd)
+{
+  struct stat st;
+  if(fstat(fd,&st) || !S_ISCHR(st.st_mode))
+    return "";
+  char path[128];
+  const char* names[] = {"device/bcdDevice","device/../bcdDevice"};
+  for(unsigned i = 0;i < sizeof(names) / sizeof(names[0]);++i)
+    {
+      snprintf(path,sizeof(path),"/sys/dev/char/%u:%u/%s",
+	       major(st.st_rdev),minor(st.st_rdev),names[i]);
+      FILE* file = fopen(path,"r");
+      if(!file)
+	continue;
+      char firmware[16] = "";
+      if(!fgets(firmware,sizeof(firmware),file))
+	firmware[0] = '\0';
+      fclose(file);
+      firmware[strcspn(firmware,"\n")] = '\0';
+      return firmware;
+    }
+  return "";
+}
+
+static std::string _field(const unsigned char* s,size_t size)
+{
+  return std::string((const char*)s,strnlen((const char*)s,size));
+}
+
+CapabilityCache::CapabilityCache(int fd) :
+  m_fd(fd),
+  m_hit(false)
+{
+  DEB_CONSTRUCTOR();
+
+  if(v4l2_ioctl(m_fd,VIDIOC_QUERYCAP,&m_cap) == -1)
+    THROW_HW_ERROR(Error) << "Error querying cap: " << strerror(errno);
+
+  char version[16];
+  snprintf(version,sizeof(version),"%u",m_cap.version);
+  m_key = _field(m_cap.driver,sizeof(m_cap.driver)) + "|" +
+    _field(m_cap.card,sizeof(m_cap.card)) + "|" +
+    _field(m_cap.bus_info,sizeof(m_cap.bus_info)) + "|" +
+    version + "|" + _firmware(m_fd);
+  m_key.erase(std::remove(m_key.begin(),m_key.end(),'\n'),m_key.end());
+
+  std::string dir = _cache_dir();
+  if(!dir.empty())
+    {
+      // FNV-1a of the key, the key itself is checked on load
+      unsigned long long hash = 14695981039346656037ULL;
+      for(size_t i = 0;i < m_key.size();++i)
+	hash = (hash ^ (unsigned char)m_key[i]) * 1099511628211ULL;
+      char name[32];
+      snprintf(name,sizeof(name),"/%016llx.caps",hash);
+      m_path = dir + name;
+    }
+
+  m_data.time_per_frame = false;
+  m_data.autoexp_value = -1;
+  m_hit = !m_path.empty() && _load() && _checkFirstFormat();
+  if(!m_hit)
+    {
+      m_data.formats.clear();
+      m_data.controls.clear();
+      m_data.time_per_frame = false;
+      m_data.autoexp_value = -1;
+    }
+  DEB_TRACE() << DEB_VAR3(m_key,m_path,m_hit);
+}
+
+void CapabilityCache::save()
+{
+  DEB_MEMBER_FUNCT();
+  if(m_path.empty())
+    return;
+
+  // the directory (and ~/.cache) may not exist yet
+  for(size_t pos = m_path.find('/',1);pos != std::string::npos;
+      pos = m_path.find('/',pos + 1))
+    mkdir(m_path.substr(0,pos).c_str(),0755);
+
+  // written aside then renamed, a reader never sees a partial file
+  char tmp_path[64];
+  snprintf(tmp_path,sizeof(tmp_path),".%d.tmp",int(getpid()));
+  std::string tmp = m_path + tmp_path;
+  FILE* file = fopen(tmp.c_str(),"w");
+  if(!file)
+    {
+      DEB_WARNING() << "Can't write the capability cache " << tmp << ": "
+		    << strerror(errno);
+      return;
+    }
+  fprintf(file,"%s %d\n",CACHE_MAGIC,int(Version));
+  fprintf(file,"key %s\n",m_key.c_str());
+  fprintf(file,"time_per_frame %d\n",int(m_data.time_per_frame));
+  fprintf(file,"autoexp %d\n",m_data.autoexp_value);
+  for(size_t i = 0;i < m_data.formats.size();++i)
+    fprintf(file,"format %08x\n",m_data.formats[i]);
+  for(size_t i = 0;i < m_data.controls.size();++i)
+    {
+      const Controls::Info& info = m_data.controls[i];
+      fprintf(file,"control %08x %u %lld %lld %lld %lld %08x %s\n",
+	      info.id,info.type,info.minimum,info.maximum,info.step,
+	      info.default_value,info.flags,info.name.c_str());
+    }
+  bool ok = !ferror(file);
+  ok = !fclose(file) && ok;
+  if(!ok || rename(tmp.c_str(),m_path.c_str()))
+    {
+      DEB_WARNING() << "Can't write the capability cache " << m_path << ": "
+		    << strerror(errno);
+      unlink(tmp.c_str());
+    }
+}
+
+bool CapabilityCache::_load()
+{
+  DEB_MEMBER_FUNCT();
+
+  FILE* file = fopen(m_path.c_str(),"r");
+  if(!file)
+    return false;
+
+  bool valid = false;
+  char line[512];
+  int version;
+  char magic[sizeof(CACHE_MAGIC)];
+  if(fgets(line,sizeof(line),file) &&
+     sscanf(line,"%12s %d",magic,&version) == 2 &&
+     !strcmp(magic,CACHE_MAGIC) && version == Version &&
+     fgets(line,sizeof(line),file) && !strncmp(line,"key ",4))
+    {
+      line[strcspn(line,"\n")] = '\0';
+      valid = m_key == line + 4;
+    }
+  while(valid && fgets(line,sizeof(line),file))
+    {
+      line[strcspn(line,"\n")] = '\0';
+      int value,offset;
+      unsigned int pixelformat;
+      Controls::Info info;
+      if(sscanf(line,"time_per_frame %d",&value) == 1)
+	m_data.time_per_frame = value;
+      else if(sscanf(line,"autoexp %d",&value) == 1)
+	m_data.autoexp_value = value;
+      else if(sscanf(line,"format %x",&pixelformat) == 1)
+	m_data.formats.push_back(pixelformat);
+      else if(sscanf(line,"control %x %u %lld %lld %lld %lld %x %n",
+		     &info.id,&info.type,&info.minimum,&info.maximum,&info.step,
+		     &info.default_value,&info.flags,&offset) == 7)
+	{
+	  info.name = line + offset;
+	  info.value = info.default_value;
+	  m_data.controls.push_back(info);
+	}
+      else
+	valid = false;
+    }
+  fclose(file);
+
+  if(!valid)
+    DEB_TRACE() << "Stale capability cache " << m_path;
+  return valid && !m_data.formats.empty();
+}
+
+// a firmware or driver change not reflected by the key changes the formats
+bool CapabilityCache::_checkFirstFormat()
+{
+  DEB_MEMBER_FUNCT();
+
+  struct v4l2_fmtdesc formatdesc;
+  memset(&formatdesc,0,sizeof(formatdesc));
+  formatdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  formatdesc.index = 0;
+  return v4l2_ioctl(m_fd,VIDIOC_ENUM_FMT,&formatdesc) != -1 &&
+    formatdesc.pixelformat == m_data.formats[0];
+}
@@ -0,0 +1,431 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <vector>
+#include <libv4l2.h>
+#include "lima/Exceptions.h"
+#include "V4L2Controls.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+inline bool _has_value(const Controls::Info& info)
+{
+  if(info.flags & (V4L2_CTRL_FLAG_WRITE_ONLY | V4L2_CTRL_FLAG_DISABLED))
+    return false;
+  switch(info.type)
+    {
+    case V4L2_CTRL_TYPE_INTEGER:
+    case V4L2_CTRL_TYPE_BOOLEAN:
+    case V4L2_CTRL_TYPE_MENU:
+    case V4L2_CTRL_TYPE_INTEGER_MENU:
+    case V4L2_CTRL_TYPE_BITMASK:
+    case V4L2_CTRL_TYPE_INTEGER64:
+      return true;
+    default:
+      return false;
+    }
+}
+
+Controls::Controls(int fd,const std::vector<Info>* infos) :
+  m_fd(fd),
+  m_events_supported(false)
+{
+  DEB_CONSTRUCTOR();
+
+  if(infos)
+    for(size_t i = 0;i < infos->size();++i)
+      m_controls[(*infos)[i].id] = (*infos)[i];
+  else
+    _enumerate();
+  _readValues();
+  _subscribeEvents();
+}
+
+Controls::~Controls()
+{
+  DEB_DESTRUCTOR();
+}
+
+void Controls::getInfos(std::vector<Info>& infos)
+{
+  DEB_MEMBER_FUNCT();
+
+  processEvents();
+  AutoMutex aLock(m_mutex);
+  infos.clear();
+  for(InfoMap::iterator i = m_controls.begin();i != m_controls.end();++i)
+    infos.push_back(i->second);
+}
+
+bool Controls::isSupported(unsigned int id)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(id);
+
+  AutoMutex aLock(m_mutex);
+  bool supported = m_controls.find(id) != m_controls.end();
+
+  DEB_RETURN() << DEB_VAR1(supported);
+  return supported;
+}
+
+void Controls::getInfo(unsigned int id,Info& info)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(id);
+
+  processEvents();
+  AutoMutex aLock(m_mutex);
+  info = _getInfo(id);
+}
+
+void Controls::getRange(unsigned int id,long long& min,long long& max)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(id);
+
+  processEvents();
+  AutoMutex aLock(m_mutex);
+  Info& info = _getInfo(id);
+  min = info.minimum,max = info.maximum;
+
+  DEB_RETURN() << DEB_VAR2(min,max);
+}
+
+bool Controls::isMenuItemSupported(unsigned int id,int index)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(id,index);
+
+  struct v4l2_querymenu querymenu;
+  memset(&querymenu,0,sizeof(querymenu));
+  querymenu.id = id;
+  querymenu.index = index;
+  bool supported = isSupported(id);
+  if(supported)
+    {
+      AutoMutex aLock(m_mutex);
+      supported = v4l2_ioctl(m_fd,VIDIOC_QUERYMENU,&querymenu) != -1;
+    }
+
+  DEB_RETURN() << DEB_VAR1(supported);
+  return supported;
+}
+
+long long Controls::getValue(unsigned int id)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(id);
+
+  processEvents();
+  AutoMutex aLock(m_mutex);
+  Info& info = _getInfo(id);
+  // volatile controls (e.g. exposure in auto mode) change without event,
+  // and without events the cache can't be trusted for any of them
+  if((info.flags & V4L2_CTRL_FLAG_VOLATILE) || !m_events_supported)
+    {
+      struct v4l2_ext_control ctrl;
+      memset(&ctrl,0,sizeof(ctrl));
+      ctrl.id = id;
+      struct v4l2_ext_controls ctrls;
+      memset(&ctrls,0,sizeof(ctrls));
+      ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+      ctrls.count = 1;
+      ctrls.controls = &ctrl;
+      if(v4l2_ioctl(m_fd,VIDIOC_G_EXT_CTRLS,&ctrls) == -1)
+	THROW_HW_ERROR(Error) << "Can't get control " << info.name << ": "
+			      << strerror(errno);
+      info.value = info.type == V4L2_CTRL_TYPE_INTEGER64 ? ctrl.value64 : ctrl.value;
+    }
+  long long value = info.value;
+
+  DEB_RETURN() << DEB_VAR1(value);
+  return value;
+}
+
+void Controls::setValue(unsigned int id,long long value)
+{
+  DEB_MEMBER_FUNCT();
+
+  ValueMap values;
+  values[id] = value;
+  setValues(values);
+}
+
+void Controls::setValues(ValueMap& values)
+{
+  DEB_MEMBER_FUNCT();
+  if(values.empty())
+    return;
+
+  AutoMutex aLock(m_mutex);
+  std::vector<struct v4l2_ext_control> ctrl_list(values.size());
+  memset(&ctrl_list[0],0,ctrl_list.size() * sizeof(struct v4l2_ext_control));
+  int i = 0;
+  for(ValueMap::iterator v = values.begin();v != values.end();++v,++i)
+    {
+      Info& info = _getInfo(v->first);
+      DEB_PARAM() << DEB_VAR2(info.name,v->second);
+      if(info.flags & V4L2_CTRL_FLAG_READ_ONLY)
+	THROW_HW_ERROR(InvalidValue) << "Control " << info.name << " is read only";
+      ctrl_list[i].id = v->first;
+      if(info.type == V4L2_CTRL_TYPE_INTEGER64)
+	ctrl_list[i].value64 = v->second;
+      else
+	ctrl_list[i].value = int(v->second);
+    }
+
+  struct v4l2_ext_controls ctrls;
+  memset(&ctrls,0,sizeof(ctrls));
+  ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+  ctrls.count = ctrl_list.size();
+  ctrls.controls = &ctrl_list[0];
+  if(v4l2_ioctl(m_fd,VIDIOC_S_EXT_CTRLS,&ctrls) == -1)
+    {
+      std::string name = ctrls.error_idx < ctrls.count ?
+	_getInfo(ctrl_list[ctrls.error_idx].id).name : std::string("?");
+      THROW_HW_ERROR(Error) << "Can't set control " << name << ": "
+			    << strerror(errno);
+    }
+
+  i = 0;
+  for(ValueMap::iterator v = values.begin();v != values.end();++v,++i)
+    {
+      Info& info = _getInfo(v->first);
+      v->second = info.type == V4L2_CTRL_TYPE_INTEGER64 ?
+	ctrl_list[i].value64 : ctrl_list[i].value;
+      info.value = v->second;
+    }
+}
+
+void Controls::processEvents()
+{
+  DEB_MEMBER_FUNCT();
+
+  // poll and dequeue never block, the lock also keeps m_fd
+  AutoMutex aLock(m_mutex);
+  if(!m_events_supported)
+    return;
+
+  struct pollfd fd;
+  fd.fd = m_fd;
+  fd.events = POLLPRI;
+  while(poll(&fd,1,0) > 0 && (fd.revents & POLLPRI))
+    {
+      struct v4l2_event event;
+      memset(&event,0,sizeof(event));
+      if(v4l2_ioctl(m_fd,VIDIOC_DQEVENT,&event) == -1)
+	break;
+      if(event.type != V4L2_EVENT_CTRL)
+	continue;
+
+      InfoMap::iterator i = m_controls.find(event.id);
+      if(i == m_controls.end())
+	continue;
+      Info& info = i->second;
+      const struct v4l2_event_ctrl& ctrl = event.u.ctrl;
+      if(ctrl.changes & V4L2_EVENT_CTRL_CH_VALUE)
+	info.value = info.type == V4L2_CTRL_TYPE_INTEGER64 ? ctrl.value64 : ctrl.value;
+      if(ctrl.changes & V4L2_EVENT_CTRL_CH_FLAGS)
+	info.flags = ctrl.flags;
+      if(ctrl.changes & V4L2_EVENT_CTRL_CH_RANGE)
+	{
+	  info.minimum = ctrl.minimum;
+	  info.maximum = ctrl.maximum;
+	  info.step = ctrl.step;
+	  info.default_value = ctrl.default_value;
+	}
+      DEB_TRACE() << "Control event: " << DEB_VAR2(info.name,info.value);
+    }
+}
+
+void Controls::setFd(int fd)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(fd);
+
+  AutoMutex aLock(m_mutex);
+  m_fd = fd;
+}
+
+void Controls::restore()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_mutex);
+  // one by one: a control refused in the current mode (e.g. the manual
+  // exposure with auto exposure on) must not drop the others
+  for(InfoMap::iterator i = m_controls.begin();i != m_controls.end();++i)
+    {
+      Info& info = i->second;
+      if(info.flags & (V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_INACTIVE))
+	continue;
+      struct v4l2_ext_control ctrl;
+      memset(&ctrl,0,sizeof(ctrl));
+      ctrl.id = info.id;
+      if(info.type == V4L2_CTRL_TYPE_INTEGER64)
+	ctrl.value64 = info.value;
+      else
+	ctrl.value = int(info.value);
+      struct v4l2_ext_controls ctrls;
+      memset(&ctrls,0,sizeof(ctrls));
+      ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+      ctrls.count = 1;
+      ctrls.controls = &ctrl;
+      if(v4l2_ioctl(m_fd,VIDIOC_S_EXT_CTRLS,&ctrls) == -1)
+	DEB_TRACE() << "Can't restore " << info.name << ": " << strerror(errno);
+    }
+  _readValues();
+  _subscribeEvents();
+}
+
+void Controls::_enumerate()
+{
+  DEB_MEMBER_FUNCT();
+
+  struct v4l2_query_ext_ctrl query;
+  memset(&query,0,sizeof(query));
+  query.id = V4L2_CTRL_FLAG_NEXT_CTRL;
+  while(v4l2_ioctl(m_fd,VIDIOC_QUERY_EXT_CTRL,&query) != -1)
+    {
+      if(query.type != V4L2_CTRL_TYPE_CTRL_CLASS && !(query.flags & V4L2_CTRL_FLAG_DISABLED))
+	{
+	  Info info;
+	  info.id = query.id;
+	  info.type = query.type;
+	  info.name = std::string(query.name,strnlen(query.name,sizeof(query.name)));
+	  info.minimum = query.minimum;
+	  info.maximum = query.maximum;
+	  info.step = query.step;
+	  info.default_value = query.default_value;
+	  info.flags = query.flags;
+	  info.value = query.default_value;
+	  m_controls[info.id] = info;
+	}
+      query.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+    }
+  if(m_controls.empty())
+    {
+      // old kernel, fall back to VIDIOC_QUERYCTRL
+      struct v4l2_queryctrl qctrl;
+      memset(&qctrl,0,sizeof(qctrl));
+      qctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
+      while(v4l2_ioctl(m_fd,VIDIOC_QUERYCTRL,&qctrl) != -1)
+	{
+	  if(qctrl.type != V4L2_CTRL_TYPE_CTRL_CLASS && !(qctrl.flags & V4L2_CTRL_FLAG_DISABLED))
+	    {
+	      Info info;
+	      info.id = qctrl.id;
+	      info.type = qctrl.type;
+	      info.name = std::string((char*)qctrl.name,strnlen((char*)qctrl.name,sizeof(qctrl.name)));
+	      info.minimum = qctrl.minimum;
+	      info.maximum = qctrl.maximum;
+	      info.step = qctrl.step;
+	      info.default_value = qctrl.default_value;
+	      info.flags = qctrl.flags;
+	      info.value = qctrl.default_value;
+	      m_controls[info.id] = info;
+	    }
+	  qctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+	}
+    }
+  DEB_TRACE() << "Found " << m_controls.size() << " controls";
+}
+
+// All current values are read with one VIDIOC_G_EXT_CTRLS,
+// control by control if the driver refuses the group.
+void Controls::_readValues()
+{
+  DEB_MEMBER_FUNCT();
+
+  std::vector<struct v4l2_ext_control> ctrl_list;
+  for(InfoMap::iterator i = m_controls.begin();i != m_controls.end();++i)
+    if(_has_value(i->second))
+      {
+	struct v4l2_ext_control ctrl;
+	memset(&ctrl,0,sizeof(ctrl));
+	ctrl.id = i->first;
+	ctrl_list.push_back(ctrl);
+      }
+  if(ctrl_list.empty())
+    return;
+
+  struct v4l2_ext_controls ctrls;
+  memset(&ctrls,0,sizeof(ctrls));
+  ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+  ctrls.count = ctrl_list.size();
+  ctrls.controls = &ctrl_list[0];
+  bool group_ok = v4l2_ioctl(m_fd,VIDIOC_G_EXT_CTRLS,&ctrls) != -1;
+
+  for(size_t i = 0;i < ctrl_list.size();++i)
+    {
+      Info& info = m_controls[ctrl_list[i].id];
+      if(!group_ok)
+	{
+	  ctrls.count = 1;
+	  ctrls.controls = &ctrl_list[i];
+	  if(v4l2_ioctl(m_fd,VIDIOC_G_EXT_CTRLS,&ctrls) == -1)
+	    {
+	      DEB_WARNING() << "Can't read control " << info.name << ": " << strerror(errno);
+	      continue;
+	    }
+	}
+      info.value = info.type == V4L2_CTRL_TYPE_INTEGER64 ?
+	ctrl_list[i].value64 : ctrl_list[i].value;
+      DEB_TRACE() << DEB_VAR2(info.name,info.value);
+    }
+}
+
+void Controls::_subscribeEvents()
+{
+  DEB_MEMBER_FUNCT();
+
+  m_events_supported = true;
+  for(InfoMap::iterator i = m_controls.begin();i != m_controls.end();++i)
+    {
+      struct v4l2_event_subscription sub;
+      memset(&sub,0,sizeof(sub));
+      sub.type = V4L2_EVENT_CTRL;
+      sub.id = i->first;
+      if(v4l2_ioctl(m_fd,VIDIOC_SUBSCRIBE_EVENT,&sub) == -1)
+	{
+	  // the flags are left as the device reported them, they may be
+	  // saved in the CapabilityCache: getValue reads the device instead
+	  DEB_WARNING() << "Control events not supported: " << strerror(errno);
+	  m_events_supported = false;
+	  break;
+	}
+    }
+}
+
+Controls::Info& Controls::_getInfo(unsigned int id)
+{
+  DEB_MEMBER_FUNCT();
+
+  InfoMap::iterator i = m_controls.find(id);
+  if(i == m_controls.end())
+    THROW_HW_ERROR(NotSupported) << "Control " << DEB_VAR1(id) << " not supported";
+  return i->second;
+}
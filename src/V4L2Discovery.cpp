@@ -0,0 +1,352 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include <algorithm>
+#include <map>
+#include "lima/Exceptions.h"
+#include "lima/ThreadUtils.h"
+#include "V4L2Discovery.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+static const char BY_PATH_DIR[] = "/dev/v4l/by-path";
+
+static int _xioctl(int fd,unsigned long request,void* arg)
+{
+  int ret;
+  do
+    ret = ioctl(fd,request,arg);
+  while(ret == -1 && errno == EINTR);
+  return ret;
+}
+
+static std::string _field(const unsigned char* s,size_t size)
+{
+  return std::string((const char*)s,strnlen((const char*)s,size));
+}
+
+static double _seconds(const struct v4l2_fract& fract)
+{
+  return fract.denominator ? double(fract.numerator) / fract.denominator : 0.;
+}
+
+static std::string _realpath(const std::string& path)
+{
+  char resolved[PATH_MAX];
+  return realpath(path.c_str(),resolved) ? std::string(resolved) : std::string();
+}
+
+static int _node_number(const std::string& path)
+{
+  return atoi(path.c_str() + path.rfind("video") + 5);
+}
+
+static bool _by_node_number(const std::string& a,const std::string& b)
+{
+  return _node_number(a) < _node_number(b);
+}
+
+// the /dev/videoN nodes, by node number
+static void _videoNodes(std::vector<std::string>& paths)
+{
+  DIR* dir = opendir("/dev");
+  if(!dir)
+    THROW_HW_ERROR(Error) << "Can't list /dev: " << strerror(errno);
+  while(struct dirent* entry = readdir(dir))
+    if(!strncmp(entry->d_name,"video",5) && entry->d_name[5] &&
+       strspn(entry->d_name + 5,"0123456789") == strlen(entry->d_name + 5))
+      paths.push_back(std::string("/dev/") + entry->d_name);
+  closedir(dir);
+  std::sort(paths.begin(),paths.end(),_by_node_number);
+}
+
+static void _enumIntervals(int fd,unsigned int pixelformat,Discovery::FrameSize& size)
+{
+  struct v4l2_frmivalenum frmival;
+  memset(&frmival,0,sizeof(frmival));
+  frmival.pixel_format = pixelformat;
+  frmival.width = size.max_width;
+  frmival.height = size.max_height;
+  for(frmival.index = 0;_xioctl(fd,VIDIOC_ENUM_FRAMEINTERVALS,&frmival) != -1;
+      ++frmival.index)
+    {
+      Discovery::Interval interval;
+      if(frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE)
+	{
+	  interval.min = interval.max = _seconds(frmival.discrete);
+	  interval.step = 0.;
+	}
+      else
+	{
+	  interval.min = _seconds(frmival.stepwise.min);
+	  interval.max = _seconds(frmival.stepwise.max);
+	  interval.step = _seconds(frmival.stepwise.step);
+	}
+      size.intervals.push_back(interval);
+      if(frmival.type != V4L2_FRMIVAL_TYPE_DISCRETE)
+	break;
+    }
+}
+
+static void _enumFormats(int fd,std::vector<Discovery::Format>& formats)
+{
+  struct v4l2_fmtdesc fmtdesc;
+  memset(&fmtdesc,0,sizeof(fmtdesc));
+  fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  for(fmtdesc.index = 0;_xioctl(fd,VIDIOC_ENUM_FMT,&fmtdesc) != -1;++fmtdesc.index)
+    {
+      Discovery::Format format;
+      format.pixelformat = fmtdesc.pixelformat;
+      format.description = _field(fmtdesc.description,sizeof(fmtdesc.description));
+      format.flags = fmtdesc.flags;
+
+      struct v4l2_frmsizeenum frmsize;
+      memset(&frmsize,0,sizeof(frmsize));
+      frmsize.pixel_format = fmtdesc.pixelformat;
+      for(frmsize.index = 0;_xioctl(fd,VIDIOC_ENUM_FRAMESIZES,&frmsize) != -1;
+	  ++frmsize.index)
+	{
+	  Discovery::FrameSize size;
+	  if(frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE)
+	    {
+	      size.min_width = size.max_width = frmsize.discrete.width;
+	      size.min_height = size.max_height = frmsize.discrete.height;
+	      size.step_width = size.step_height = 0;
+	    }
+	  else
+	    {
+	      size.min_width = frmsize.stepwise.min_width;
+	      size.min_height = frmsize.stepwise.min_height;
+	      size.max_width = frmsize.stepwise.max_width;
+	      size.max_height = frmsize.stepwise.max_height;
+	      size.step_width = frmsize.stepwise.step_width;
+	      size.step_height = frmsize.stepwise.step_height;
+	    }
+	  _enumIntervals(fd,fmtdesc.pixelformat,size);
+	  format.sizes.push_back(size);
+	  if(frmsize.type != V4L2_FRMSIZE_TYPE_DISCRETE)
+	    break;
+	}
+      formats.push_back(format);
+    }
+}
+
+// false if the node is not a capture device
+static bool _probe(Discovery::Device& device,bool with_formats)
+{
+  int fd = open(device.path.c_str(),O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if(fd < 0)
+    {
+      // kept: the tooling should know a camera is there but not usable
+      device.error = strerror(errno);
+      return true;
+    }
+
+  struct v4l2_capability cap;
+  memset(&cap,0,sizeof(cap));
+  bool capture = _xioctl(fd,VIDIOC_QUERYCAP,&cap) != -1;
+  if(capture)
+    {
+      unsigned int caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ?
+	cap.device_caps : cap.capabilities;
+      capture = caps & V4L2_CAP_VIDEO_CAPTURE;
+    }
+  if(capture)
+    {
+      device.driver = _field(cap.driver,sizeof(cap.driver));
+      device.card = _field(cap.card,sizeof(cap.card));
+      device.bus_info = _field(cap.bus_info,sizeof(cap.bus_info));
+      device.version = cap.version;
+      if(with_formats)
+	_enumFormats(fd,device.formats);
+    }
+  close(fd);
+  return capture;
+}
+
+namespace
+{
+  struct _Scan
+  {
+    Cond				cond;
+    std::vector<Discovery::Device>	devices;
+    std::vector<bool>			capture;
+    size_t				next;
+    int					nb_running;
+    bool				with_formats;
+  };
+
+  class _ScanThread : public Thread
+  {
+    DEB_CLASS_NAMESPC(DebModCamera,"Discovery","_ScanThread");
+  public:
+    _ScanThread(_Scan& scan) : m_scan(scan) {}
+  protected:
+    virtual void threadFunction();
+  private:
+    _Scan& m_scan;
+  };
+
+  void _ScanThread::threadFunction()
+  {
+    AutoMutex aLock(m_scan.cond.mutex());
+    while(m_scan.next < m_scan.devices.size())
+      {
+	size_t index = m_scan.next++;
+	aLock.unlock();
+	// slow USB firmwares: the nodes are probed in parallel
+	bool capture = _probe(m_scan.devices[index],m_scan.with_formats);
+	aLock.lock();
+	m_scan.capture[index] = capture;
+      }
+    --m_scan.nb_running;
+    m_scan.cond.broadcast();
+  }
+}
+
+void Discovery::scan(std::vector<Device>& devices,int nb_threads,bool with_formats)
+{
+  DEB_STATIC_FUNCT();
+  DEB_PARAM() << DEB_VAR2(nb_threads,with_formats);
+
+  std::vector<std::string> paths;
+  _videoNodes(paths);
+
+  std::map<std::string,std::string> by_path;
+  DIR* dir;
+  if((dir = opendir(BY_PATH_DIR)))
+    {
+      while(struct dirent* entry = readdir(dir))
+	{
+	  if(entry->d_name[0] == '.')
+	    continue;
+	  std::string link = std::string(BY_PATH_DIR) + "/" + entry->d_name;
+	  std::string node = _realpath(link);
+	  // the shortest link of a node (no -video-index suffix duplicates)
+	  if(!node.empty() &&
+	     (by_path[node].empty() || link.size() < by_path[node].size()))
+	    by_path[node] = link;
+	}
+      closedir(dir);
+    }
+
+  _Scan scan;
+  scan.devices.resize(paths.size());
+  for(size_t i = 0;i < paths.size();++i)
+    {
+      scan.devices[i].path = paths[i];
+      scan.devices[i].version = 0;
+    }
+  scan.capture.assign(paths.size(),false);
+  scan.next = 0;
+  scan.with_formats = with_formats;
+  if(nb_threads <= 0)
+    nb_threads = std::min(int(paths.size()),32);
+  nb_threads = std::max(std::min(nb_threads,int(paths.size())),1);
+  scan.nb_running = nb_threads;
+
+  std::vector<_ScanThread*> threads;
+  for(int i = 0;i < nb_threads;++i)
+    {
+      threads.push_back(new _ScanThread(scan));
+      threads.back()->start();
+    }
+  AutoMutex aLock(scan.cond.mutex());
+  while(scan.nb_running)
+    scan.cond.wait();
+  aLock.unlock();
+  for(size_t i = 0;i < threads.size();++i)
+    delete threads[i];
+
+  devices.clear();
+  for(size_t i = 0;i < scan.devices.size();++i)
+    if(scan.capture[i])
+      {
+	Device& device = scan.devices[i];
+	std::map<std::string,std::string>::iterator link =
+	  by_path.find(_realpath(device.path));
+	if(link != by_path.end())
+	  device.by_path = link->second;
+	devices.push_back(device);
+      }
+  DEB_TRACE() << "Found " << devices.size() << " capture devices";
+}
+
+std::string Discovery::findDevice(const std::string& bus_info)
+{
+  DEB_STATIC_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bus_info);
+
+  std::string link = bus_info.find('/') == std::string::npos ?
+    std::string(BY_PATH_DIR) + "/" + bus_info : bus_info;
+  std::string node = _realpath(link);
+  if(!node.empty() && node.compare(0,10,"/dev/video") == 0)
+    return node;
+
+  std::vector<Device> devices;
+  scan(devices,0,false);
+  for(size_t i = 0;i < devices.size();++i)
+    if(devices[i].bus_info == bus_info && devices[i].error.empty())
+      {
+	DEB_RETURN() << DEB_VAR1(devices[i].path);
+	return devices[i].path;
+      }
+  THROW_HW_ERROR(InvalidValue) << "No capture device on " << bus_info;
+}
+
+std::string Discovery::findMetadataDevice(const std::string& bus_info)
+{
+  DEB_STATIC_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bus_info);
+
+  std::vector<std::string> paths;
+  _videoNodes(paths);
+  for(size_t i = 0;i < paths.size();++i)
+    {
+      int fd = open(paths[i].c_str(),O_RDWR | O_NONBLOCK | O_CLOEXEC);
+      if(fd < 0)
+	continue;
+      struct v4l2_capability cap;
+      memset(&cap,0,sizeof(cap));
+      bool found = _xioctl(fd,VIDIOC_QUERYCAP,&cap) != -1 &&
+	(cap.capabilities & V4L2_CAP_DEVICE_CAPS) &&
+	(cap.device_caps & V4L2_CAP_META_CAPTURE) &&
+	_field(cap.bus_info,sizeof(cap.bus_info)) == bus_info;
+      close(fd);
+      if(found)
+	{
+	  DEB_RETURN() << DEB_VAR1(paths[i]);
+	  return paths[i];
+	}
+    }
+  THROW_HW_ERROR(NotSupported) << "No metadata device on " << bus_info;
+}
@@ -0,0 +1,357 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include "V4L2FrameRing.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+static const char RING_MAGIC[8] = {'L','I','M','A','R','I','N','G'};
+
+static std::string _shm_name(const std::string& name)
+{
+  return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+static inline FrameRing::Slot* _slot(FrameRing::Header* header,uint64_t count)
+{
+  return (FrameRing::Slot*)((char*)header + FrameRing::HeaderSize +
+			    (count % header->nb_slots) * header->slot_stride);
+}
+
+static inline unsigned char* _slot_data(FrameRing::Slot* slot)
+{
+  return (unsigned char*)slot + FrameRing::SlotHeaderSize;
+}
+
+FrameRing::FrameRing() :
+  m_nb_slots(0),
+  m_generation(0),
+  m_header(NULL),
+  m_map_size(0)
+{
+}
+
+FrameRing::~FrameRing()
+{
+  destroy();
+}
+
+void FrameRing::create(const std::string& name,int nb_slots,size_t slot_size)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR3(name,nb_slots,slot_size);
+
+  if(nb_slots < 2)
+    THROW_HW_ERROR(InvalidValue) << "At least 2 slots are needed";
+
+  destroy();
+  m_name = _shm_name(name);
+  m_nb_slots = nb_slots;
+  _map(slot_size,0);
+}
+
+void FrameRing::destroy()
+{
+  if(!m_header)
+    return;
+  // tell the readers the ring is gone
+  __atomic_store_n(&m_header->generation,m_generation + 1,__ATOMIC_RELEASE);
+  ++m_generation;
+  _unmap();
+}
+
+bool FrameRing::publish(const unsigned char* data,const Slot& info)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_header)
+    return false;
+  if(info.size > m_header->slot_size)
+    {
+      DEB_TRACE() << "Growing " << m_name << " slots to " << info.size << " bytes";
+      uint64_t write_count = m_header->write_count;
+      __atomic_store_n(&m_header->generation,m_generation + 1,__ATOMIC_RELEASE);
+      ++m_generation;
+      _unmap();
+      try
+	{
+	  // the frame counts go on in the new ring
+	  _map(info.size,write_count);
+	}
+      catch(Exception&)
+	{
+	  return false;
+	}
+    }
+
+  // only this process writes, no need for an atomic read
+  uint64_t count = m_header->write_count;
+  Slot* slot = _slot(m_header,count);
+  uint32_t seq = slot->seq;
+  __atomic_store_n(&slot->seq,seq + 1,__ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->video_mode = info.video_mode;
+  slot->count = count;
+  slot->timestamp = info.timestamp;
+  slot->frame_id = info.frame_id;
+  slot->sequence = info.sequence;
+  slot->width = info.width;
+  slot->height = info.height;
+  slot->size = info.size;
+  memcpy(_slot_data(slot),data,info.size);
+
+  __atomic_store_n(&slot->seq,seq + 2,__ATOMIC_RELEASE);
+  __atomic_store_n(&m_header->write_count,count + 1,__ATOMIC_RELEASE);
+  return true;
+}
+
+long long FrameRing::getNbPublished() const
+{
+  return m_header ? __atomic_load_n(&m_header->write_count,__ATOMIC_ACQUIRE) : 0;
+}
+
+void FrameRing::_map(size_t slot_size,uint64_t write_count)
+{
+  DEB_MEMBER_FUNCT();
+
+  size_t stride = (SlotHeaderSize + slot_size + 63) & ~size_t(63);
+  size_t size = HeaderSize + stride * m_nb_slots;
+
+  // a new object, readers of a previous one keep their mapping
+  shm_unlink(m_name.c_str());
+  int fd = shm_open(m_name.c_str(),O_CREAT | O_EXCL | O_RDWR,0644);
+  if(fd < 0)
+    THROW_HW_ERROR(Error) << "Can't create " << m_name << ": " << strerror(errno);
+  if(ftruncate(fd,size))
+    {
+      int error = errno;
+      close(fd);
+      shm_unlink(m_name.c_str());
+      THROW_HW_ERROR(Error) << "Can't size " << m_name << ": " << strerror(error);
+    }
+  void* base = mmap(NULL,size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+  close(fd);
+  if(base == MAP_FAILED)
+    {
+      shm_unlink(m_name.c_str());
+      THROW_HW_ERROR(Error) << "Can't map " << m_name << ": " << strerror(errno);
+    }
+
+  // ftruncate gives zeroed pages: all slots are empty (seq 0)
+  m_header = (Header*)base;
+  m_map_size = size;
+  m_header->version = Version;
+  m_header->nb_slots = m_nb_slots;
+  m_header->slot_size = slot_size;
+  m_header->slot_stride = stride;
+  m_header->generation = m_generation;
+  m_header->write_count = write_count;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(m_header->magic,RING_MAGIC,sizeof(RING_MAGIC));
+}
+
+void FrameRing::_unmap()
+{
+  munmap(m_header,m_map_size);
+  shm_unlink(m_name.c_str());
+  m_header = NULL;
+  m_map_size = 0;
+}
+
+FrameRingReader::FrameRingReader(const std::string& name) :
+  m_name(_shm_name(name)),
+  m_header(NULL),
+  m_map_size(0),
+  m_generation(0),
+  m_cursor(0),
+  m_acquired(NULL),
+  m_acquired_seq(0),
+  m_nb_lost(0)
+{
+  DEB_CONSTRUCTOR();
+  DEB_PARAM() << DEB_VAR1(name);
+  _open();
+}
+
+FrameRingReader::~FrameRingReader()
+{
+  _close();
+  for(size_t i = 0;i < m_retired.size();++i)
+    munmap(m_retired[i].first,m_retired[i].second);
+}
+
+bool FrameRingReader::acquire(const unsigned char*& data,FrameRing::Slot& info)
+{
+  DEB_MEMBER_FUNCT();
+
+  m_acquired = NULL;
+  if(!m_header ||
+     __atomic_load_n(&m_header->generation,__ATOMIC_ACQUIRE) != m_generation)
+    {
+      // the ring was replaced (larger frames) or the writer is gone
+      uint64_t cursor = m_cursor;
+      _close();
+      try
+	{
+	  _open();
+	}
+      catch(Exception&)
+	{
+	  return false;
+	}
+      // a larger ring goes on with the frame counts of the old one
+      if(cursor < m_cursor)
+	m_cursor = cursor;
+    }
+
+  uint64_t nb_slots = m_header->nb_slots;
+  while(true)
+    {
+      uint64_t write_count = __atomic_load_n(&m_header->write_count,__ATOMIC_ACQUIRE);
+      if(m_cursor >= write_count)
+	return false;
+      if(write_count - m_cursor > nb_slots)
+	{
+	  m_nb_lost += write_count - nb_slots - m_cursor;
+	  m_cursor = write_count - nb_slots;
+	}
+
+      FrameRing::Slot* slot = _slot(m_header,m_cursor);
+      uint32_t seq = __atomic_load_n(&slot->seq,__ATOMIC_ACQUIRE);
+      if(!(seq & 1) && slot->count == m_cursor)
+	{
+	  info = *slot;
+	  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+	  if(__atomic_load_n(&slot->seq,__ATOMIC_RELAXED) == seq)
+	    {
+	      ++m_cursor;
+	      m_acquired = slot;
+	      m_acquired_seq = seq;
+	      data = _slot_data(slot);
+	      return true;
+	    }
+	}
+      // being overwritten by a newer frame
+      ++m_nb_lost;
+      ++m_cursor;
+    }
+}
+
+bool FrameRingReader::acquire(Frame& frame,double timeout)
+{
+  const unsigned char* data;
+  FrameRing::Slot info;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  double deadline = now.tv_sec + now.tv_nsec * 1e-9 + timeout;
+  while(!acquire(data,info))
+    {
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      if(now.tv_sec + now.tv_nsec * 1e-9 >= deadline)
+	return false;
+      usleep(100);
+    }
+
+  frame.data = data;
+  frame.size = info.size;
+  frame.count = info.count;
+  frame.timestamp = info.timestamp;
+  frame.frame_id = info.frame_id;
+  frame.sequence = info.sequence;
+  frame.width = info.width;
+  frame.height = info.height;
+  frame.video_mode = info.video_mode;
+  return true;
+}
+
+bool FrameRingReader::release()
+{
+  if(!m_acquired)
+    return false;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  bool valid = __atomic_load_n(&m_acquired->seq,__ATOMIC_RELAXED) == m_acquired_seq;
+  if(!valid)
+    ++m_nb_lost;
+  m_acquired = NULL;
+  return valid;
+}
+
+void FrameRingReader::seekLatest()
+{
+  if(!m_header)
+    return;
+  uint64_t write_count = __atomic_load_n(&m_header->write_count,__ATOMIC_ACQUIRE);
+  m_cursor = write_count ? write_count - 1 : 0;
+}
+
+void FrameRingReader::_open()
+{
+  DEB_MEMBER_FUNCT();
+
+  int fd = shm_open(m_name.c_str(),O_RDONLY,0);
+  if(fd < 0)
+    THROW_HW_ERROR(Error) << "Can't open " << m_name << ": " << strerror(errno);
+  struct stat st;
+  if(fstat(fd,&st) || size_t(st.st_size) < size_t(FrameRing::HeaderSize))
+    {
+      close(fd);
+      THROW_HW_ERROR(Error) << m_name << " is not a frame ring";
+    }
+  void* base = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if(base == MAP_FAILED)
+    THROW_HW_ERROR(Error) << "Can't map " << m_name << ": " << strerror(errno);
+
+  FrameRing::Header* header = (FrameRing::Header*)base;
+  if(memcmp(header->magic,RING_MAGIC,sizeof(RING_MAGIC)) ||
+     header->version != FrameRing::Version || !header->nb_slots ||
+     FrameRing::HeaderSize + header->slot_stride * header->nb_slots > size_t(st.st_size))
+    {
+      munmap(base,st.st_size);
+      THROW_HW_ERROR(Error) << m_name << " is not a frame ring";
+    }
+  m_header = header;
+  m_map_size = st.st_size;
+  m_generation = __atomic_load_n(&header->generation,__ATOMIC_ACQUIRE);
+  // only the frames published from now on
+  m_cursor = __atomic_load_n(&header->write_count,__ATOMIC_ACQUIRE);
+}
+
+void FrameRingReader::_close()
+{
+  if(!m_header)
+    return;
+  m_retired.push_back(std::make_pair((void*)m_header,m_map_size));
+  m_header = NULL;
+  m_map_size = 0;
+  m_acquired = NULL;
+}
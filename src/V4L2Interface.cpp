@@ -35,12 +35,13 @@ Interface::Interface(const std::string&  dev_path)
 {
   DEB_CONSTRUCTOR();
 
-  m_fd = v4l2_open(dev_path.c_str(),O_RDWR);
-  if(m_fd < -1)
+  // owned by the video object, which replaces it if the device is reopened
+  int fd = v4l2_open(dev_path.c_str(),O_RDWR);
+  if(fd < -1)
     THROW_HW_ERROR(Error) << "Error opening: " << dev_path 
 			  << "(" << strerror(errno) << ")";
 
-  m_video = new VideoCtrlObj(m_fd);
+  m_video = new VideoCtrlObj(fd);
   m_det_info = new DetInfoCtrlObj(*m_video);
   m_sync = new SyncCtrlObj(*m_video);
   
@@ -80,7 +81,9 @@ void Interface::startAcq()
 {
   DEB_MEMBER_FUNCT();
   
-  m_video->getBuffer().setStartTimestamp(Timestamp::now());
+  // in IntTrigMult, only the first trigger starts the acquisition
+  if(!m_video->getNbHwAcquiredFrames())
+    m_video->getBuffer().setStartTimestamp(Timestamp::now());
   m_video->startAcq();
 }
 
@@ -109,3 +112,497 @@ int Interface::getNbHwAcquiredFrames()
   DEB_RETURN() << DEB_VAR1(acq_frames);
   return acq_frames;
 }
+
+bool Interface::waitNbHwAcquiredFrames(int nb_frames,double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  return m_video->waitNbHwAcquiredFrames(nb_frames,timeout);
+}
+
+bool Interface::waitAcqEnd(double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  return m_video->waitAcqEnd(timeout);
+}
+
+void Interface::setStatisticsActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setStatisticsActive(active);
+}
+
+void Interface::getStatisticsActive(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getStatisticsActive(active);
+}
+
+void Interface::getLastImageStatistics(double& min,double& max,double& mean)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getLastImageStatistics(min,max,mean);
+}
+
+void Interface::setExposureBracket(const std::vector<double>& exp_times)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setExposureBracket(exp_times);
+}
+
+void Interface::getExposureBracket(std::vector<double>& exp_times)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getExposureBracket(exp_times);
+}
+
+void Interface::setExposureLatency(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setExposureLatency(nb_frames);
+}
+
+void Interface::getExposureLatency(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getExposureLatency(nb_frames);
+}
+
+void Interface::getFrameExpTime(int frame_id,double& exp_time)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getFrameExpTime(frame_id,exp_time);
+}
+
+void Interface::setHdrActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setHdrActive(active);
+}
+
+void Interface::getHdrActive(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getHdrActive(active);
+}
+
+void Interface::setHdrSaturation(int level)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setHdrSaturation(level);
+}
+
+void Interface::getHdrSaturation(int& level)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getHdrSaturation(level);
+}
+
+void Interface::setNbBuffers(int nb_buffers)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setNbBuffers(nb_buffers);
+}
+
+void Interface::getNbBuffers(int& nb_buffers)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbBuffers(nb_buffers);
+}
+
+void Interface::setKeepStreaming(bool keep)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setKeepStreaming(keep);
+}
+
+void Interface::getKeepStreaming(bool& keep)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getKeepStreaming(keep);
+}
+
+void Interface::getFirstFrameDelay(double& delay)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getFirstFrameDelay(delay);
+}
+
+void Interface::setBufferPrefault(bool prefault)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setBufferPrefault(prefault);
+}
+
+void Interface::getBufferPrefault(bool& prefault)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getBufferPrefault(prefault);
+}
+
+void Interface::getModeSwitchTime(double& time)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getModeSwitchTime(time);
+}
+
+void Interface::selectVideoMode(VideoMode mode,int min_width,int min_height,
+				double min_fps)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->selectVideoMode(mode,min_width,min_height,min_fps);
+}
+
+void Interface::getFrameRate(double& fps)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getFrameRate(fps);
+}
+
+void Interface::setDecodeRate(double pixels_per_second)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setDecodeRate(pixels_per_second);
+}
+
+void Interface::getDecodeRate(double& pixels_per_second)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getDecodeRate(pixels_per_second);
+}
+
+void Interface::setLiveLatestFrame(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setLiveLatestFrame(active);
+}
+
+void Interface::getLiveLatestFrame(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getLiveLatestFrame(active);
+}
+
+void Interface::getDisplayLatency(double& latency)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getDisplayLatency(latency);
+}
+
+void Interface::getNbSkippedFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbSkippedFrames(nb_frames);
+}
+
+void Interface::setMaxBufferMemory(int mbytes)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setMaxBufferMemory(mbytes);
+}
+
+void Interface::getMaxBufferMemory(int& mbytes)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getMaxBufferMemory(mbytes);
+}
+
+void Interface::getNbStarvations(int& nb_starvations)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbStarvations(nb_starvations);
+}
+
+void Interface::getMinQueuedBuffers(int& nb_buffers)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getMinQueuedBuffers(nb_buffers);
+}
+
+void Interface::getNbDroppedFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbDroppedFrames(nb_frames);
+}
+
+void Interface::setFrameTimeout(double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setFrameTimeout(timeout);
+}
+
+void Interface::getFrameTimeout(double& timeout)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getFrameTimeout(timeout);
+}
+
+void Interface::setReconnectTimeout(double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setReconnectTimeout(timeout);
+}
+
+void Interface::getReconnectTimeout(double& timeout)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getReconnectTimeout(timeout);
+}
+
+void Interface::getNbStreamRestarts(int& nb_restarts)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbStreamRestarts(nb_restarts);
+}
+
+void Interface::getNbReconnects(int& nb_reconnects)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbReconnects(nb_reconnects);
+}
+
+void Interface::getNbFrameErrors(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbFrameErrors(nb_frames);
+}
+
+void Interface::setCorruptFramePolicy(CorruptFramePolicy policy)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setCorruptFramePolicy(policy);
+}
+
+void Interface::getCorruptFramePolicy(CorruptFramePolicy& policy)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getCorruptFramePolicy(policy);
+}
+
+void Interface::getNbCorruptFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbCorruptFrames(nb_frames);
+}
+
+void Interface::getFrameCorrupt(int frame_id,bool& corrupt)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getFrameCorrupt(frame_id,corrupt);
+}
+
+void Interface::setMetadataActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setMetadataActive(active);
+}
+
+void Interface::getMetadataActive(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getMetadataActive(active);
+}
+
+void Interface::getFrameMetadata(int frame_id,MetadataStream::Frame& frame)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getFrameMetadata(frame_id,frame);
+}
+
+void Interface::setDeviceClockFrequency(double frequency)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setDeviceClockFrequency(frequency);
+}
+
+void Interface::getDeviceClockFrequency(double& frequency)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getDeviceClockFrequency(frequency);
+}
+
+void Interface::setPreviewActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setPreviewActive(active);
+}
+
+void Interface::getPreviewActive(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getPreviewActive(active);
+}
+
+void Interface::setPreviewFactor(int factor)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setPreviewFactor(factor);
+}
+
+void Interface::getPreviewFactor(int& factor)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getPreviewFactor(factor);
+}
+
+void Interface::setPreviewMaxRate(double max_rate)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setPreviewMaxRate(max_rate);
+}
+
+void Interface::getPreviewMaxRate(double& max_rate)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getPreviewMaxRate(max_rate);
+}
+
+void Interface::getPreviewImage(int& frame_id,int& width,int& height,int& depth,
+				std::vector<unsigned char>& data)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getPreviewImage(frame_id,width,height,depth,data);
+}
+
+void Interface::setAccNbFrames(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setAccNbFrames(nb_frames);
+}
+
+void Interface::getAccNbFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getAccNbFrames(nb_frames);
+}
+
+void Interface::setAccAverage(bool average)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setAccAverage(average);
+}
+
+void Interface::getAccAverage(bool& average)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getAccAverage(average);
+}
+
+void Interface::setCorrectionActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setCorrectionActive(active);
+}
+
+void Interface::getCorrectionActive(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getCorrectionActive(active);
+}
+
+void Interface::setReferenceCapture(Reference ref)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setReferenceCapture(ref);
+}
+
+void Interface::getReferenceCapture(Reference& ref)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getReferenceCapture(ref);
+}
+
+void Interface::loadReference(Reference ref,const std::string& path)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->loadReference(ref,path);
+}
+
+void Interface::saveReference(Reference ref,const std::string& path)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->saveReference(ref,path);
+}
+
+void Interface::clearReference(Reference ref)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->clearReference(ref);
+}
+
+void Interface::startRecording(const std::string& path)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->startRecording(path);
+}
+
+void Interface::stopRecording()
+{
+  DEB_MEMBER_FUNCT();
+  m_video->stopRecording();
+}
+
+void Interface::getRecordingActive(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getRecordingActive(active);
+}
+
+void Interface::getNbRecordedFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbRecordedFrames(nb_frames);
+}
+
+void Interface::getNbRecordingStalls(int& nb_stalls)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbRecordingStalls(nb_stalls);
+}
+
+void Interface::setRecordingCompressed(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setRecordingCompressed(active);
+}
+
+void Interface::getRecordingCompressed(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getRecordingCompressed(active);
+}
+
+void Interface::setRecordingLiveRate(double rate)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->setRecordingLiveRate(rate);
+}
+
+void Interface::getRecordingLiveRate(double& rate)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getRecordingLiveRate(rate);
+}
+
+void Interface::startFrameRing(const std::string& name,int nb_slots)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->startFrameRing(name,nb_slots);
+}
+
+void Interface::stopFrameRing()
+{
+  DEB_MEMBER_FUNCT();
+  m_video->stopFrameRing();
+}
+
+void Interface::getFrameRingActive(bool& active)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getFrameRingActive(active);
+}
+
+void Interface::getNbPublishedFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  m_video->getNbPublishedFrames(nb_frames);
+}
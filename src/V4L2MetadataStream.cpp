@@ -0,0 +1,321 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <linux/videodev2.h>
+#include "lima/Exceptions.h"
+#include "V4L2MetadataStream.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+// UVC payload header bmHeaderInfo
+#define UVC_STREAM_PTS	0x04
+#define UVC_STREAM_SCR	0x08
+
+static int _xioctl(int fd,unsigned long request,void* arg)
+{
+  int ret;
+  do
+    ret = ioctl(fd,request,arg);
+  while(ret == -1 && errno == EINTR);
+  return ret;
+}
+
+static inline uint32_t _le32(const unsigned char* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+static inline uint16_t _le16(const unsigned char* p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+MetadataStream::MetadataStream() :
+  m_fd(-1),
+  m_length(0),
+  m_streaming(false),
+  m_pending(-1),
+  m_pending_sequence(0),
+  m_pending_size(0),
+  m_clock_frequency(0.),
+  m_pts_base(0),
+  m_last_pts(0)
+{
+}
+
+MetadataStream::~MetadataStream()
+{
+  close();
+}
+
+void MetadataStream::open(const std::string& path,int nb_buffers)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(path,nb_buffers);
+
+  close();
+  // non blocking: a missing buffer must not stall the video
+  m_fd = ::open(path.c_str(),O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if(m_fd < 0)
+    THROW_HW_ERROR(Error) << "Can't open " << path << ": " << strerror(errno);
+  m_path = path;
+
+  struct v4l2_format format;
+  memset(&format,0,sizeof(format));
+  format.type = V4L2_BUF_TYPE_META_CAPTURE;
+  format.fmt.meta.dataformat = V4L2_META_FMT_UVC;
+  if(_xioctl(m_fd,VIDIOC_S_FMT,&format) == -1 ||
+     format.fmt.meta.dataformat != V4L2_META_FMT_UVC)
+    {
+      close();
+      THROW_HW_ERROR(NotSupported) << path << " has no UVC metadata format";
+    }
+
+  struct v4l2_requestbuffers requestbuff;
+  memset(&requestbuff,0,sizeof(requestbuff));
+  requestbuff.count = nb_buffers;
+  requestbuff.type = V4L2_BUF_TYPE_META_CAPTURE;
+  requestbuff.memory = V4L2_MEMORY_MMAP;
+  if(_xioctl(m_fd,VIDIOC_REQBUFS,&requestbuff) == -1)
+    {
+      int error = errno;
+      close();
+      THROW_HW_ERROR(Error) << "req. metadata buffers: " << strerror(error);
+    }
+  for(unsigned i = 0;i < requestbuff.count;++i)
+    {
+      struct v4l2_buffer buffer;
+      memset(&buffer,0,sizeof(buffer));
+      buffer.type = V4L2_BUF_TYPE_META_CAPTURE;
+      buffer.memory = V4L2_MEMORY_MMAP;
+      buffer.index = i;
+      void* p = MAP_FAILED;
+      if(_xioctl(m_fd,VIDIOC_QUERYBUF,&buffer) != -1)
+	p = mmap(NULL,buffer.length,PROT_READ | PROT_WRITE,MAP_SHARED,m_fd,buffer.m.offset);
+      if(p == MAP_FAILED)
+	{
+	  int error = errno;
+	  close();
+	  THROW_HW_ERROR(Error) << "mapping metadata buffer " << i << ": " << strerror(error);
+	}
+      m_length = buffer.length;
+      m_buffers.push_back(p);
+    }
+
+  if(m_clock_frequency <= 0.)
+    m_clock_frequency = _readClockFrequency(path);
+  DEB_TRACE() << DEB_VAR2(m_buffers.size(),m_clock_frequency);
+}
+
+void MetadataStream::close()
+{
+  if(m_fd < 0)
+    return;
+  stop();
+  for(size_t i = 0;i < m_buffers.size();++i)
+    munmap(m_buffers[i],m_length);
+  m_buffers.clear();
+  ::close(m_fd);
+  m_fd = -1;
+}
+
+void MetadataStream::start()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_fd < 0 || m_streaming)
+    return;
+  for(size_t i = 0;i < m_buffers.size();++i)
+    if(!_queue(i))
+      THROW_HW_ERROR(Error) << "Error queue metadata buff " << strerror(errno);
+  int type = V4L2_BUF_TYPE_META_CAPTURE;
+  if(_xioctl(m_fd,VIDIOC_STREAMON,&type) == -1)
+    THROW_HW_ERROR(Error) << "Error starting metadata stream : " << strerror(errno);
+  m_streaming = true;
+  m_pending = -1;
+  m_pts_base = 0;
+  m_last_pts = 0;
+}
+
+void MetadataStream::stop()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_streaming)
+    return;
+  int type = V4L2_BUF_TYPE_META_CAPTURE;
+  if(_xioctl(m_fd,VIDIOC_STREAMOFF,&type) == -1)
+    DEB_ERROR() << "Error stopping metadata stream : " << strerror(errno);
+  m_streaming = false;
+  m_pending = -1;
+}
+
+bool MetadataStream::getFrame(uint32_t sequence,Frame& frame)
+{
+  DEB_MEMBER_FUNCT();
+
+  while(m_streaming)
+    {
+      if(m_pending < 0)
+	{
+	  struct v4l2_buffer buffer;
+	  memset(&buffer,0,sizeof(buffer));
+	  buffer.type = V4L2_BUF_TYPE_META_CAPTURE;
+	  buffer.memory = V4L2_MEMORY_MMAP;
+	  if(_xioctl(m_fd,VIDIOC_DQBUF,&buffer) == -1)
+	    {
+	      if(errno != EAGAIN)
+		DEB_ERROR() << "Error dequeue metadata buff : " << strerror(errno);
+	      return false;
+	    }
+	  m_pending = buffer.index;
+	  m_pending_sequence = buffer.sequence;
+	  m_pending_size = buffer.bytesused;
+	}
+      // a frame dropped on either side: wait for the video or skip
+      if(int32_t(m_pending_sequence - sequence) > 0)
+	return false;
+      int index = m_pending;
+      bool found = m_pending_sequence == sequence;
+      if(found)
+	_parse(index,m_pending_size,frame);
+      m_pending = -1;
+      _queue(index);
+      if(found)
+	{
+	  frame.sequence = sequence;
+	  return true;
+	}
+    }
+  return false;
+}
+
+bool MetadataStream::_queue(int index)
+{
+  struct v4l2_buffer buffer;
+  memset(&buffer,0,sizeof(buffer));
+  buffer.type = V4L2_BUF_TYPE_META_CAPTURE;
+  buffer.memory = V4L2_MEMORY_MMAP;
+  buffer.index = index;
+  return _xioctl(m_fd,VIDIOC_QBUF,&buffer) != -1;
+}
+
+/** blocks of struct uvc_meta_buf: ns (8 bytes), sof (2), then the UVC
+ *  payload header (bHeaderLength, bmHeaderInfo, PTS, SCR). The first
+ *  packet of the frame gives the host time, PTS is the same for all.
+ */
+void MetadataStream::_parse(int index,unsigned int size,Frame& frame)
+{
+  const unsigned char* data = (const unsigned char*)m_buffers[index];
+  frame.has_pts = frame.has_scr = false;
+  frame.host_time = 0;
+  frame.host_sof = 0;
+  frame.device_time = -1.;
+  bool first = true;
+  for(unsigned int offset = 0;offset + 12 <= size;)
+    {
+      const unsigned char* block = data + offset;
+      unsigned int length = block[10];
+      if(length < 2 || offset + 10 + length > size)
+	break;
+      unsigned char flags = block[11];
+      const unsigned char* p = block + 12;
+      const unsigned char* end = block + 10 + length;
+      if(first)
+	{
+	  int64_t ns;
+	  memcpy(&ns,block,sizeof(ns));
+	  frame.host_time = ns;
+	  frame.host_sof = _le16(block + 8);
+	  first = false;
+	}
+      if(flags & UVC_STREAM_PTS)
+	{
+	  if(p + 4 > end)
+	    break;
+	  if(!frame.has_pts)
+	    {
+	      frame.pts = _le32(p);
+	      frame.has_pts = true;
+	    }
+	  p += 4;
+	}
+      if((flags & UVC_STREAM_SCR) && !frame.has_scr && p + 6 <= end)
+	{
+	  frame.scr_stc = _le32(p);
+	  frame.scr_sof = _le16(p + 4) & 0x7ff;
+	  frame.has_scr = true;
+	}
+      offset += 10 + length;
+    }
+
+  if(frame.has_pts)
+    {
+      if(frame.pts < m_last_pts)
+	m_pts_base += int64_t(1) << 32;
+      m_last_pts = frame.pts;
+      if(m_clock_frequency > 0.)
+	frame.device_time = (m_pts_base + frame.pts) / m_clock_frequency;
+    }
+}
+
+/** dwClockFrequency of the VideoControl interface header, from the
+ *  USB descriptors in sysfs (0 for UVC 1.5 devices, which drop it).
+ */
+double MetadataStream::_readClockFrequency(const std::string& path)
+{
+  DEB_STATIC_FUNCT();
+
+  std::string node = path.substr(path.rfind('/') + 1);
+  std::string sysfs = "/sys/class/video4linux/" + node + "/device/../descriptors";
+  FILE* f = fopen(sysfs.c_str(),"rb");
+  if(!f)
+    return 0.;
+  std::vector<unsigned char> descriptors(65536);
+  size_t size = fread(&descriptors[0],1,descriptors.size(),f);
+  fclose(f);
+
+  bool video_control = false;
+  for(size_t offset = 0;offset + 2 <= size;)
+    {
+      const unsigned char* d = &descriptors[offset];
+      if(!d[0])
+	break;
+      if(d[1] == 0x04 && d[0] >= 9)			// interface
+	video_control = d[5] == 0x0e && d[6] == 0x01;	// video, control
+      else if(video_control && d[1] == 0x24 && d[2] == 0x01 &&	// VC_HEADER
+	      d[0] >= 12 && offset + 12 <= size)
+	return _le32(d + 7);
+      offset += d[0];
+    }
+  return 0.;
+}
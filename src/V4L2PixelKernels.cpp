@@ -0,0 +1,213 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#ifdef V4L2_WITH_X86_KERNELS
+#include <cpuid.h>
+#endif
+#include "V4L2PixelKernels.h"
+
+using namespace lima::V4L2;
+
+namespace lima
+{
+  namespace V4L2
+  {
+    namespace Kernels
+    {
+      extern const Table scalar_table;
+#ifdef V4L2_WITH_X86_KERNELS
+      extern const Table sse2_table;
+      extern const Table avx2_table;
+      extern const Table avx512_table;
+#endif
+    }
+  }
+}
+
+static Kernels::CpuFeatures _detect_cpu_features()
+{
+  Kernels::CpuFeatures features;
+  memset(&features,0,sizeof(features));
+#ifdef V4L2_WITH_X86_KERNELS
+  unsigned int eax,ebx,ecx,edx;
+  if(!__get_cpuid(1,&eax,&ebx,&ecx,&edx))
+    return features;
+  features.sse2 = edx & bit_SSE2;
+  // the AVX2 and AVX-512 kernels are also built with -mfma
+  bool fma = ecx & bit_FMA;
+
+  // the OS must save the extended registers on context switch
+  unsigned long long xcr0 = 0;
+  if(ecx & bit_OSXSAVE)
+    {
+      unsigned int xcr0_lo,xcr0_hi;
+      __asm__ ("xgetbv" : "=a"(xcr0_lo),"=d"(xcr0_hi) : "c"(0));
+      xcr0 = (unsigned long long)xcr0_hi << 32 | xcr0_lo;
+    }
+  bool ymm_state = (xcr0 & 0x06) == 0x06;
+  bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+
+  if(__get_cpuid_count(7,0,&eax,&ebx,&ecx,&edx))
+    {
+      features.avx2 = ymm_state && fma && (ebx & bit_AVX2);
+      features.avx512 = features.avx2 && zmm_state &&
+	(ebx & bit_AVX512F) && (ebx & bit_AVX512BW) && (ebx & bit_AVX512VL);
+    }
+#endif
+  return features;
+}
+
+// Level used by the plugin: the best one for this cpu,
+// unless a lower one is requested through LIMA_V4L2_SIMD_LEVEL
+static Kernels::SimdLevel _select_simd_level()
+{
+  Kernels::SimdLevel level = Kernels::getBestSimdLevel();
+  const char* requested = getenv("LIMA_V4L2_SIMD_LEVEL");
+  if(requested)
+    for(int l = Kernels::Scalar;l < level;++l)
+      if(!strcasecmp(requested,Kernels::getSimdLevelName(Kernels::SimdLevel(l))))
+	level = Kernels::SimdLevel(l);
+  return level;
+}
+
+const char* Kernels::getSimdLevelName(SimdLevel level)
+{
+  switch(level)
+    {
+    case Scalar:	return "scalar";
+    case SSE2:		return "sse2";
+    case AVX2:		return "avx2";
+    case AVX512:	return "avx512";
+    default:		return "unknown";
+    }
+}
+
+const char* Kernels::getKernelName(Kernel kernel)
+{
+  switch(kernel)
+    {
+    case YUYV_2_Y8:		return "YUYV->Y8";
+    case UYVY_2_Y8:		return "UYVY->Y8";
+    case RGB24_2_Y8:		return "RGB24->Y8";
+    case BAYER_BG8_2_RGB24:	return "BAYER_BG8->RGB24";
+    case PACKED10_2_Y16:	return "PACKED10->Y16";
+    default:			return "unknown";
+    }
+}
+
+int Kernels::getSrcLineSize(Kernel kernel,int width)
+{
+  switch(kernel)
+    {
+    case YUYV_2_Y8:
+    case UYVY_2_Y8:		return width * 2;
+    case RGB24_2_Y8:		return width * 3;
+    case BAYER_BG8_2_RGB24:	return width;
+    case PACKED10_2_Y16:	return (width * 5 + 3) / 4;
+    default:			return 0;
+    }
+}
+
+int Kernels::getDstPixelDepth(Kernel kernel)
+{
+  switch(kernel)
+    {
+    case BAYER_BG8_2_RGB24:	return 3;
+    case PACKED10_2_Y16:	return 2;
+    default:			return 1;
+    }
+}
+
+const Kernels::CpuFeatures& Kernels::getCpuFeatures()
+{
+  // may be called by the static initializers of other files
+  static const CpuFeatures features = _detect_cpu_features();
+  return features;
+}
+
+const Kernels::Table* Kernels::getTable(SimdLevel level)
+{
+  switch(level)
+    {
+    case Scalar:	return &scalar_table;
+#ifdef V4L2_WITH_X86_KERNELS
+    case SSE2:		return &sse2_table;
+    case AVX2:		return &avx2_table;
+    case AVX512:	return &avx512_table;
+#endif
+    default:		return NULL;
+    }
+}
+
+bool Kernels::isSupported(SimdLevel level)
+{
+  if(!getTable(level))
+    return false;
+
+  const CpuFeatures& features = getCpuFeatures();
+  switch(level)
+    {
+    case SSE2:		return features.sse2;
+    case AVX2:		return features.avx2;
+    case AVX512:	return features.avx512;
+    default:		return true;
+    }
+}
+
+Kernels::SimdLevel Kernels::getBestSimdLevel()
+{
+  int level = NbSimdLevel - 1;
+  while(level > Scalar && !isSupported(SimdLevel(level)))
+    --level;
+  return SimdLevel(level);
+}
+
+Kernels::SimdLevel Kernels::getSimdLevel()
+{
+  // same as getCpuFeatures
+  static const SimdLevel simd_level = _select_simd_level();
+  return simd_level;
+}
+
+const Kernels::Table& Kernels::getKernels()
+{
+  static const Table& kernels = *getTable(getSimdLevel());
+  return kernels;
+}
+
+Kernels::ConvFunc Kernels::getConvFunc(Kernel kernel)
+{
+  return getKernels().conv[kernel];
+}
+
+Kernels::BinFunc Kernels::getBinFunc(PixelType type,int bin_x,int bin_y)
+{
+  const Table& kernels = getKernels();
+  if(bin_x == 2 && bin_y == 2)
+    return kernels.bin2x2[type];
+  if(bin_x == 4 && bin_y == 4)
+    return kernels.bin4x4[type];
+  return kernels.bin[type];
+}
@@ -0,0 +1,352 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Kernel bodies, included by every V4L2PixelKernels<Level>.cpp.
+// The including file defines V4L2_KERNEL_TABLE, the name of the table
+// to export; the instruction set comes from that file compile flags.
+// Loops are kept simple (restrict pointers, no aliasing, no early exit)
+// so the compiler can vectorize them for the requested level.
+// Everything lives in an anonymous namespace and no C++ library header
+// is used: an inline function shared between levels could otherwise be
+// linked from the highest ISA and end up running on any cpu.
+
+#ifndef V4L2_KERNEL_TABLE
+#error "V4L2_KERNEL_TABLE must be defined before including this file"
+#endif
+
+#include <string.h>
+#include "V4L2PixelKernels.h"
+
+namespace lima
+{
+  namespace V4L2
+  {
+    namespace Kernels
+    {
+      namespace
+      {
+	void _yuyv_2_y8(const unsigned char* src,int src_stride,
+			unsigned char* dst,int width,int height)
+	{
+	  for(int y = 0;y < height;++y)
+	    {
+	      const unsigned char* __restrict__ s = src + y * src_stride;
+	      unsigned char* __restrict__ d = dst + y * width;
+	      for(int x = 0;x < width;++x)
+		d[x] = s[2 * x];
+	    }
+	}
+
+	void _uyvy_2_y8(const unsigned char* src,int src_stride,
+			unsigned char* dst,int width,int height)
+	{
+	  for(int y = 0;y < height;++y)
+	    {
+	      const unsigned char* __restrict__ s = src + y * src_stride;
+	      unsigned char* __restrict__ d = dst + y * width;
+	      for(int x = 0;x < width;++x)
+		d[x] = s[2 * x + 1];
+	    }
+	}
+
+	void _rgb24_2_y8(const unsigned char* src,int src_stride,
+			 unsigned char* dst,int width,int height)
+	{
+	  for(int y = 0;y < height;++y)
+	    {
+	      const unsigned char* __restrict__ s = src + y * src_stride;
+	      unsigned char* __restrict__ d = dst + y * width;
+	      for(int x = 0;x < width;++x)
+		{
+		  unsigned int r = s[3 * x];
+		  unsigned int g = s[3 * x + 1];
+		  unsigned int b = s[3 * x + 2];
+		  d[x] = (unsigned char)((77 * r + 150 * g + 29 * b + 128) >> 8);
+		}
+	    }
+	}
+
+	// BGGR: each 2x2 cell gives one B, two G and one R, the resulting
+	// RGB triplet is written on the four pixels of the cell.
+	void _bayer_bg8_2_rgb24(const unsigned char* src,int src_stride,
+				unsigned char* dst,int width,int height)
+	{
+	  int cell_width = width / 2;
+	  int cell_height = height / 2;
+	  int dst_stride = width * 3;
+	  for(int y = 0;y < cell_height;++y)
+	    {
+	      const unsigned char* __restrict__ s0 = src + 2 * y * src_stride;
+	      const unsigned char* __restrict__ s1 = s0 + src_stride;
+	      unsigned char* __restrict__ d0 = dst + 2 * y * dst_stride;
+	      unsigned char* __restrict__ d1 = d0 + dst_stride;
+	      for(int x = 0;x < cell_width;++x)
+		{
+		  unsigned char b = s0[2 * x];
+		  unsigned char g = (unsigned char)((s0[2 * x + 1] + s1[2 * x] + 1) >> 1);
+		  unsigned char r = s1[2 * x + 1];
+		  d0[6 * x] = r;	d0[6 * x + 1] = g;	d0[6 * x + 2] = b;
+		  d0[6 * x + 3] = r;	d0[6 * x + 4] = g;	d0[6 * x + 5] = b;
+		  d1[6 * x] = r;	d1[6 * x + 1] = g;	d1[6 * x + 2] = b;
+		  d1[6 * x + 3] = r;	d1[6 * x + 4] = g;	d1[6 * x + 5] = b;
+		}
+	      if(width & 1)		// replicate the last column
+		for(int c = 0;c < 3;++c)
+		  {
+		    d0[(width - 1) * 3 + c] = d0[(width - 2) * 3 + c];
+		    d1[(width - 1) * 3 + c] = d1[(width - 2) * 3 + c];
+		  }
+	    }
+	  if(height & 1)		// replicate the last line
+	    {
+	      unsigned char* last = dst + (height - 1) * dst_stride;
+	      for(int x = 0;x < dst_stride;++x)
+		last[x] = last[x - dst_stride];
+	    }
+	}
+
+	// 4 pixels in 5 bytes: 4 x 8 msb then the 4 x 2 lsb
+	void _packed10_2_y16(const unsigned char* src,int src_stride,
+			     unsigned char* dst,int width,int height)
+	{
+	  int nb_groups = width / 4;
+	  int remain = width % 4;
+	  for(int y = 0;y < height;++y)
+	    {
+	      const unsigned char* __restrict__ s = src + y * src_stride;
+	      unsigned short* __restrict__ d = (unsigned short*)dst + y * width;
+	      for(int g = 0;g < nb_groups;++g)
+		{
+		  unsigned short lsb = s[5 * g + 4];
+		  d[4 * g]     = (unsigned short)((s[5 * g] << 2)     | (lsb & 0x3));
+		  d[4 * g + 1] = (unsigned short)((s[5 * g + 1] << 2) | ((lsb >> 2) & 0x3));
+		  d[4 * g + 2] = (unsigned short)((s[5 * g + 2] << 2) | ((lsb >> 4) & 0x3));
+		  d[4 * g + 3] = (unsigned short)((s[5 * g + 3] << 2) | (lsb >> 6));
+		}
+	      if(remain)
+		{
+		  const unsigned char* rs = s + 5 * nb_groups;
+		  unsigned short* rd = d + 4 * nb_groups;
+		  for(int i = 0;i < remain;++i)
+		    rd[i] = (unsigned short)((rs[i] << 2) | ((rs[remain] >> (2 * i)) & 0x3));
+		}
+	    }
+	}
+
+	void _crop(const unsigned char* src,int src_stride,
+		   unsigned char* dst,int line_size,int height)
+	{
+	  for(int y = 0;y < height;++y)
+	    memcpy(dst + y * line_size,src + y * src_stride,line_size);
+	}
+
+	// source lines are first summed column by column, then each group
+	// of bin_x columns is reduced to one pixel. Columns are processed by
+	// chunks to keep the sums on the stack.
+	template<class T>
+	void _bin(const unsigned char* src,int src_stride,
+		  unsigned char* dst,int width,int height,
+		  int bin_x,int bin_y)
+	{
+	  enum {MAX_COLUMNS = 4096};
+	  unsigned int col[MAX_COLUMNS];
+	  unsigned int nb_pixels = bin_x * bin_y;
+	  int chunk_width = MAX_COLUMNS / bin_x;
+	  for(int y = 0;y < height;++y)
+	    {
+	      T* d = (T*)dst + y * width;
+	      for(int x0 = 0;x0 < width;x0 += chunk_width)
+		{
+		  int nb_out = width - x0 < chunk_width ? width - x0 : chunk_width;
+		  int nb_columns = nb_out * bin_x;
+		  const T* __restrict__ s = (const T*)(src + y * bin_y * src_stride) + x0 * bin_x;
+		  for(int x = 0;x < nb_columns;++x)
+		    col[x] = s[x];
+		  for(int l = 1;l < bin_y;++l)
+		    {
+		      const T* __restrict__ sl = (const T*)(src + (y * bin_y + l) * src_stride) + x0 * bin_x;
+		      for(int x = 0;x < nb_columns;++x)
+			col[x] += sl[x];
+		    }
+		  T* __restrict__ dc = d + x0;
+		  if(bin_x == 2)
+		    for(int x = 0;x < nb_out;++x)
+		      dc[x] = T((col[2 * x] + col[2 * x + 1]) / nb_pixels);
+		  else
+		    for(int x = 0;x < nb_out;++x)
+		      {
+			unsigned int sum = 0;
+			for(int b = 0;b < bin_x;++b)
+			  sum += col[x * bin_x + b];
+			dc[x] = T(sum / nb_pixels);
+		      }
+		}
+	    }
+	}
+
+	// binning factors known at compile time: no column buffer, each
+	// output pixel is a fixed size reduction the compiler unrolls and
+	// vectorizes with interleaved loads, the division is a shift
+	template<class T,int BX,int BY>
+	void _bin_fixed(const unsigned char* src,int src_stride,
+			unsigned char* dst,int width,int height,
+			int,int)
+	{
+	  for(int y = 0;y < height;++y)
+	    {
+	      const unsigned char* s0 = src + y * BY * src_stride;
+	      T* __restrict__ d = (T*)dst + y * width;
+	      for(int x = 0;x < width;++x)
+		{
+		  unsigned int sum = 0;
+		  for(int l = 0;l < BY;++l)
+		    {
+		      const T* __restrict__ s = (const T*)(s0 + l * src_stride) + x * BX;
+		      for(int b = 0;b < BX;++b)
+			sum += s[b];
+		    }
+		  d[x] = T(sum / (BX * BY));
+		}
+	    }
+	}
+
+	template<class T>
+	void _stat(const unsigned char* src,int width,int height,
+		   Statistics& stat)
+	{
+	  const T* __restrict__ p = (const T*)src;
+	  long nb_pixels = long(width) * height;
+	  T min_val = T(~T(0)),max_val = 0;
+	  unsigned long long sum = 0;
+	  for(long i = 0;i < nb_pixels;++i)
+	    {
+	      T v = p[i];
+	      min_val = v < min_val ? v : min_val;
+	      max_val = v > max_val ? v : max_val;
+	      sum += v;
+	    }
+	  stat.min = nb_pixels ? min_val : 0;
+	  stat.max = max_val;
+	  stat.mean = nb_pixels ? double(sum) / nb_pixels : 0.;
+	}
+
+	// triangle weight, never null below saturation so that a dark
+	// pixel seen only in the long exposures is still merged
+	template<class T>
+	void _hdr_acc(const unsigned char* src,int nb_pixels,
+		      float exp_time,float saturation,
+		      float* sum,float* weight)
+	{
+	  const T* __restrict__ s = (const T*)src;
+	  float* __restrict__ su = sum;
+	  float* __restrict__ we = weight;
+	  float inv_exp_time = 1.f / exp_time;
+	  for(int i = 0;i < nb_pixels;++i)
+	    {
+	      float v = s[i];
+	      float w = v + 1.f < saturation - v ? v + 1.f : saturation - v;
+	      w = v < saturation ? w : 0.f;
+	      su[i] += w * v * inv_exp_time;
+	      we[i] += w;
+	    }
+	}
+
+	// converted through signed int, which vectorizes on every level
+	void _hdr_merge(const float* sum,const float* weight,int nb_pixels,
+			float scale,float fallback,unsigned int* dst)
+	{
+	  const float* __restrict__ su = sum;
+	  const float* __restrict__ we = weight;
+	  int* __restrict__ d = (int*)dst;
+	  for(int i = 0;i < nb_pixels;++i)
+	    {
+	      float w = we[i];
+	      float v = su[i] / (w > 0.f ? w : 1.f) * scale;
+	      v = w > 0.f ? v : fallback;
+	      v = v < 2147483520.f ? v : 2147483520.f;
+	      d[i] = int(v + .5f);
+	    }
+	}
+
+	template<class T>
+	void _acc(const unsigned char* src,int nb_pixels,unsigned int* acc)
+	{
+	  const T* __restrict__ s = (const T*)src;
+	  unsigned int* __restrict__ a = acc;
+	  for(int i = 0;i < nb_pixels;++i)
+	    a[i] += s[i];
+	}
+
+	// double division: exact rounding, and unlike the integer one
+	// it vectorizes
+	template<class T>
+	void _avg(const unsigned int* acc,int nb_pixels,int nb_frames,
+		  unsigned char* dst)
+	{
+	  const int* __restrict__ a = (const int*)acc;
+	  T* __restrict__ d = (T*)dst;
+	  double half = nb_frames / 2;
+	  double divisor = nb_frames;
+	  for(int i = 0;i < nb_pixels;++i)
+	    d[i] = T(int((a[i] + half) / divisor));
+	}
+
+	template<class T>
+	void _flat_field(const unsigned char* src,int nb_pixels,
+			 const float* dark,const float* gain,
+			 unsigned short* dst)
+	{
+	  const T* __restrict__ s = (const T*)src;
+	  const float* __restrict__ dk = dark;
+	  const float* __restrict__ g = gain;
+	  unsigned short* __restrict__ d = dst;
+	  for(int i = 0;i < nb_pixels;++i)
+	    {
+	      float v = (s[i] - dk[i]) * g[i];
+	      v = v > 0.f ? v : 0.f;
+	      v = v < 65535.f ? v : 65535.f;
+	      d[i] = (unsigned short)int(v + .5f);
+	    }
+	}
+      }
+
+      extern const Table V4L2_KERNEL_TABLE;
+      const Table V4L2_KERNEL_TABLE = {
+	{_yuyv_2_y8,
+	 _uyvy_2_y8,
+	 _rgb24_2_y8,
+	 _bayer_bg8_2_rgb24,
+	 _packed10_2_y16},
+	_crop,
+	{_bin<unsigned char>,_bin<unsigned short>},
+	{_bin_fixed<unsigned char,2,2>,_bin_fixed<unsigned short,2,2>},
+	{_bin_fixed<unsigned char,4,4>,_bin_fixed<unsigned short,4,4>},
+	{_stat<unsigned char>,_stat<unsigned short>},
+	{_hdr_acc<unsigned char>,_hdr_acc<unsigned short>},
+	_hdr_merge,
+	{_acc<unsigned char>,_acc<unsigned short>},
+	{_avg<unsigned char>,_avg<unsigned short>},
+	{_flat_field<unsigned char>,_flat_field<unsigned short>}
+      };
+    }
+  }
+}
@@ -0,0 +1,471 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <libv4lconvert.h>
+#include "V4L2Recorder.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+static const char RECORD_MAGIC[8] = {'L','I','M','A','V','4','L','2'};
+// O_DIRECT needs aligned buffers, sizes and offsets
+static const size_t ALIGNMENT = 4096;
+
+static inline size_t _align(size_t size)
+{
+  return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static int _pwrite_all(int fd,const unsigned char* data,size_t size,uint64_t offset)
+{
+  while(size)
+    {
+      ssize_t ret = pwrite(fd,data,size,offset);
+      if(ret < 0)
+	{
+	  if(errno == EINTR) continue;
+	  return errno;
+	}
+      data += ret,size -= ret,offset += ret;
+    }
+  return 0;
+}
+
+class Recorder::_WriteThread : public Thread
+{
+  DEB_CLASS_NAMESPC(DebModCamera,"Recorder","_WriteThread");
+public:
+  _WriteThread(Recorder& recorder) : m_recorder(recorder) {}
+protected:
+  virtual void threadFunction();
+private:
+  Recorder& m_recorder;
+};
+
+Recorder::Recorder() :
+  m_fd(-1),
+  m_quit(false),
+  m_chunk_size(0),
+  m_fill_chunk(0),
+  m_fill_size(0),
+  m_file_offset(0),
+  m_data_size(0),
+  m_write_chunk(-1),
+  m_write_size(0),
+  m_write_offset(0),
+  m_write_error(0),
+  m_nb_stalls(0)
+{
+  m_chunks[0] = m_chunks[1] = NULL;
+  m_thread = new _WriteThread(*this);
+  m_thread->start();
+}
+
+Recorder::~Recorder()
+{
+  DEB_DESTRUCTOR();
+
+  try
+    {
+      close();
+    }
+  catch(Exception&)
+    {
+    }
+
+  AutoMutex aLock(m_cond.mutex());
+  m_quit = true;
+  m_cond.broadcast();
+  aLock.unlock();
+  delete m_thread;
+
+  free(m_chunks[0]);
+  free(m_chunks[1]);
+}
+
+void Recorder::open(const std::string& path,int chunk_size)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(path,chunk_size);
+
+  if(chunk_size <= 0)
+    THROW_HW_ERROR(InvalidValue) << "Invalid chunk size: " << chunk_size;
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_fd >= 0)
+    THROW_HW_ERROR(Error) << "Already recording to " << m_path;
+
+  size_t size = _align(chunk_size);
+  if(size != m_chunk_size)
+    {
+      free(m_chunks[0]),free(m_chunks[1]);
+      m_chunks[0] = m_chunks[1] = NULL;
+      m_chunk_size = 0;
+      void *chunk0,*chunk1;
+      if(posix_memalign(&chunk0,ALIGNMENT,size))
+	THROW_HW_ERROR(Error) << "Can't allocate the write buffers";
+      if(posix_memalign(&chunk1,ALIGNMENT,size))
+	{
+	  free(chunk0);
+	  THROW_HW_ERROR(Error) << "Can't allocate the write buffers";
+	}
+      m_chunks[0] = (unsigned char*)chunk0,m_chunks[1] = (unsigned char*)chunk1;
+      m_chunk_size = size;
+    }
+
+  int fd = ::open(path.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT,0644);
+  if(fd < 0 && errno == EINVAL)	// e.g. tmpfs
+    {
+      DEB_WARNING() << path << " doesn't support direct I/O, using the page cache";
+      fd = ::open(path.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+    }
+  if(fd < 0)
+    THROW_HW_ERROR(Error) << "Can't open " << path << ": " << strerror(errno);
+
+  // header of an unfinished file, rewritten by close
+  memset(m_chunks[0],0,HeaderSize);
+  Header* header = (Header*)m_chunks[0];
+  memcpy(header->magic,RECORD_MAGIC,sizeof(RECORD_MAGIC));
+  header->version = Version;
+  header->header_size = HeaderSize;
+  int error = _pwrite_all(fd,m_chunks[0],HeaderSize,0);
+  if(error)
+    {
+      ::close(fd);
+      THROW_HW_ERROR(Error) << "Can't write " << path << ": " << strerror(error);
+    }
+
+  m_path = path;
+  m_fd = fd;
+  m_fill_chunk = 0;
+  m_fill_size = 0;
+  m_file_offset = HeaderSize;
+  m_data_size = 0;
+  m_write_error = 0;
+  m_nb_stalls = 0;
+  m_index.clear();
+}
+
+void Recorder::close()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_fd < 0)
+    return;
+
+  // last chunk, padded to the alignment
+  if(m_fill_size)
+    {
+      size_t size = _align(m_fill_size);
+      memset(m_chunks[m_fill_chunk] + m_fill_size,0,size - m_fill_size);
+      m_fill_size = size;
+      _swapChunks();
+    }
+  _waitWrite();
+
+  int error = m_write_error;
+  uint64_t index_offset = m_file_offset;
+  if(!error)
+    {
+      // the index and the header are small, write them through the cache
+      int flags = fcntl(m_fd,F_GETFL);
+      fcntl(m_fd,F_SETFL,flags & ~O_DIRECT);
+
+      if(!m_index.empty())
+	error = _pwrite_all(m_fd,(const unsigned char*)&m_index[0],
+			    m_index.size() * sizeof(FrameEntry),index_offset);
+      if(!error)
+	{
+	  Header header;
+	  memset(&header,0,sizeof(header));
+	  memcpy(header.magic,RECORD_MAGIC,sizeof(RECORD_MAGIC));
+	  header.version = Version;
+	  header.header_size = HeaderSize;
+	  header.nb_frames = m_index.size();
+	  header.index_offset = index_offset;
+	  error = _pwrite_all(m_fd,(const unsigned char*)&header,sizeof(header),0);
+	}
+    }
+  if(::close(m_fd) && !error)
+    error = errno;
+  m_fd = -1;
+
+  DEB_TRACE() << m_path << ": " << m_index.size() << " frames, "
+	      << m_data_size << " bytes, " << m_nb_stalls << " stalls";
+  if(error)
+    THROW_HW_ERROR(Error) << "Can't write " << m_path << ": " << strerror(error);
+}
+
+bool Recorder::addFrame(const unsigned char* data,FrameEntry& entry)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_fd < 0 || m_write_error)
+    return false;
+
+  // the entry also goes in front of the payload, for a file without index
+  entry.offset = HeaderSize + m_data_size + sizeof(FrameEntry);
+  m_index.push_back(entry);
+  m_data_size += sizeof(FrameEntry) + entry.size;
+
+  _append((const unsigned char*)&entry,sizeof(FrameEntry));
+  _append(data,entry.size);
+  if(m_write_error)
+    {
+      DEB_ERROR() << "Recording to " << m_path << " failed: "
+		  << strerror(m_write_error);
+      return false;
+    }
+  return true;
+}
+
+int Recorder::getNbFrames()
+{
+  AutoMutex aLock(m_cond.mutex());
+  return m_index.size();
+}
+
+long long Recorder::getNbBytes()
+{
+  AutoMutex aLock(m_cond.mutex());
+  return m_data_size;
+}
+
+int Recorder::getNbStalls()
+{
+  AutoMutex aLock(m_cond.mutex());
+  return m_nb_stalls;
+}
+
+/// copy into the chunks, lock must be held
+void Recorder::_append(const unsigned char* data,size_t remaining)
+{
+  while(remaining)
+    {
+      size_t size = std::min(remaining,m_chunk_size - m_fill_size);
+      memcpy(m_chunks[m_fill_chunk] + m_fill_size,data,size);
+      data += size,remaining -= size;
+      m_fill_size += size;
+      if(m_fill_size == m_chunk_size)
+	_swapChunks();
+    }
+}
+
+/// hand the filled chunk to the write thread, lock must be held
+void Recorder::_swapChunks()
+{
+  if(m_write_chunk >= 0)
+    {
+      ++m_nb_stalls;
+      _waitWrite();
+    }
+  m_write_chunk = m_fill_chunk;
+  m_write_size = m_fill_size;
+  m_write_offset = m_file_offset;
+  m_cond.broadcast();
+
+  m_file_offset += m_fill_size;
+  m_fill_chunk ^= 1;
+  m_fill_size = 0;
+}
+
+void Recorder::_waitWrite()
+{
+  while(m_write_chunk >= 0)
+    m_cond.wait();
+}
+
+void Recorder::_WriteThread::threadFunction()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_recorder.m_cond.mutex());
+  while(true)
+    {
+      while(m_recorder.m_write_chunk < 0 && !m_recorder.m_quit)
+	m_recorder.m_cond.wait();
+      if(m_recorder.m_write_chunk < 0)
+	break;
+
+      const unsigned char* data = m_recorder.m_chunks[m_recorder.m_write_chunk];
+      size_t size = m_recorder.m_write_size;
+      uint64_t offset = m_recorder.m_write_offset;
+      int fd = m_recorder.m_fd;
+      bool failed = m_recorder.m_write_error != 0;
+
+      aLock.unlock();
+      int error = failed ? 0 : _pwrite_all(fd,data,size,offset);
+      aLock.lock();
+
+      if(error)
+	m_recorder.m_write_error = error;
+      m_recorder.m_write_chunk = -1;
+      m_recorder.m_cond.broadcast();
+    }
+}
+
+RecordReader::RecordReader(const std::string& path) :
+  m_base(NULL),
+  m_size(0),
+  m_nb_frames(0),
+  m_index(NULL),
+  m_decoder(NULL)
+{
+  DEB_CONSTRUCTOR();
+  DEB_PARAM() << DEB_VAR1(path);
+
+  int fd = open(path.c_str(),O_RDONLY);
+  if(fd < 0)
+    THROW_HW_ERROR(Error) << "Can't open " << path << ": " << strerror(errno);
+  struct stat st;
+  if(fstat(fd,&st))
+    {
+      close(fd);
+      THROW_HW_ERROR(Error) << "Can't stat " << path << ": " << strerror(errno);
+    }
+  m_size = st.st_size;
+  void* base = m_size ? mmap(NULL,m_size,PROT_READ,MAP_SHARED,fd,0) : MAP_FAILED;
+  close(fd);
+  if(base == MAP_FAILED)
+    THROW_HW_ERROR(Error) << "Can't map " << path;
+  m_base = (unsigned char*)base;
+
+  const Recorder::Header* header = (const Recorder::Header*)m_base;
+  if(m_size < sizeof(Recorder::Header) ||
+     memcmp(header->magic,RECORD_MAGIC,sizeof(RECORD_MAGIC)) ||
+     header->version != Recorder::Version ||
+     header->header_size < sizeof(Recorder::Header) || header->header_size > m_size)
+    {
+      munmap(m_base,m_size);
+      THROW_HW_ERROR(Error) << path << " is not a v4l2 recording";
+    }
+
+  if(!header->index_offset)
+    {
+      DEB_WARNING() << path << " has no index (unfinished recording), scanning the frames";
+      _scanFrames(header->header_size);
+      return;
+    }
+  uint64_t index_end = header->index_offset + header->nb_frames * sizeof(Recorder::FrameEntry);
+  if(header->index_offset < header->header_size || index_end > m_size)
+    {
+      munmap(m_base,m_size);
+      THROW_HW_ERROR(Error) << path << " has a truncated index";
+    }
+  m_nb_frames = header->nb_frames;
+  m_index = (const Recorder::FrameEntry*)(m_base + header->index_offset);
+}
+
+/** Rebuild the index of a file that was not closed: the frames are
+ *  taken up to the first entry that doesn't point right after itself
+ *  or whose payload goes past the end of the file (the data of the last
+ *  chunks never written).
+ */
+void RecordReader::_scanFrames(uint64_t offset)
+{
+  Recorder::FrameEntry entry;
+  while(offset + sizeof(entry) <= m_size)
+    {
+      // the entries are not aligned in the file
+      memcpy(&entry,m_base + offset,sizeof(entry));
+      offset += sizeof(entry);
+      if(entry.offset != offset || entry.size > m_size - offset)
+	break;
+      m_scanned_index.push_back(entry);
+      offset += entry.size;
+    }
+  m_nb_frames = m_scanned_index.size();
+  m_index = m_nb_frames ? &m_scanned_index[0] : NULL;
+}
+
+RecordReader::~RecordReader()
+{
+  if(m_decoder)
+    v4lconvert_destroy(m_decoder);
+  munmap(m_base,m_size);
+}
+
+const Recorder::FrameEntry& RecordReader::getFrameEntry(int frame_nb) const
+{
+  DEB_MEMBER_FUNCT();
+
+  if(frame_nb < 0 || frame_nb >= m_nb_frames)
+    THROW_HW_ERROR(InvalidValue) << "Invalid frame number: " << frame_nb;
+  return m_index[frame_nb];
+}
+
+const unsigned char* RecordReader::getFrameData(int frame_nb) const
+{
+  DEB_MEMBER_FUNCT();
+
+  const Recorder::FrameEntry& entry = getFrameEntry(frame_nb);
+  if(entry.offset + entry.size > m_size)
+    THROW_HW_ERROR(Error) << "Frame " << frame_nb << " is truncated";
+  return m_base + entry.offset;
+}
+
+void RecordReader::decodeFrame(int frame_nb,std::vector<unsigned char>& rgb)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(frame_nb);
+
+  const Recorder::FrameEntry& entry = getFrameEntry(frame_nb);
+  const unsigned char* data = getFrameData(frame_nb);
+
+  // no device behind the decoder, only the format conversions are used
+  if(!m_decoder && !(m_decoder = v4lconvert_create(-1)))
+    THROW_HW_ERROR(Error) << "Can't create the frame decoder";
+
+  struct v4l2_format src_format,dst_format;
+  memset(&src_format,0,sizeof(src_format));
+  src_format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  src_format.fmt.pix.width = entry.width;
+  src_format.fmt.pix.height = entry.height;
+  src_format.fmt.pix.pixelformat = entry.pixelformat;
+  src_format.fmt.pix.bytesperline = entry.bytesperline;
+  src_format.fmt.pix.sizeimage = entry.size;
+  src_format.fmt.pix.field = V4L2_FIELD_NONE;
+
+  dst_format = src_format;
+  dst_format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
+  dst_format.fmt.pix.bytesperline = entry.width * 3;
+  dst_format.fmt.pix.sizeimage = entry.width * entry.height * 3;
+
+  rgb.resize(dst_format.fmt.pix.sizeimage);
+  // v4lconvert doesn't write the source, the mapping is read-only
+  int ret = v4lconvert_convert(m_decoder,&src_format,&dst_format,
+			       (unsigned char*)data,entry.size,
+			       &rgb[0],rgb.size());
+  if(ret < 0)
+    THROW_HW_ERROR(Error) << "Can't decode frame " << frame_nb << ": "
+			  << v4lconvert_get_error_message(m_decoder);
+}
@@ -41,7 +41,7 @@ bool SyncCtrlObj::checkTrigMode(TrigMode trig_mode)
   DEB_MEMBER_FUNCT();
   DEB_PARAM() << DEB_VAR1(trig_mode);
 
-  bool returnValue = trig_mode == IntTrig;
+  bool returnValue = trig_mode == IntTrig || trig_mode == IntTrigMult;
 
   DEB_RETURN() << DEB_VAR1(returnValue);
 
@@ -55,13 +55,14 @@ void SyncCtrlObj::setTrigMode(TrigMode trig_mode)
 
   if(!checkTrigMode(trig_mode))
     THROW_HW_ERROR(InvalidValue) << DEB_VAR1(trig_mode) << " is not supported";
+  m_video.setTrigMode(trig_mode);
 }
 
 void SyncCtrlObj::getTrigMode(TrigMode& trig_mode)
 {
   DEB_MEMBER_FUNCT();
 
-  trig_mode = IntTrig;
+  m_video.getTrigMode(trig_mode);
 
   DEB_RETURN() << DEB_VAR1(trig_mode);
 }
@@ -89,6 +90,14 @@ bool SyncCtrlObj::checkAutoExposureMode(AutoExposureMode mode) const
   else return true;
 }
 
+void SyncCtrlObj::setHwAutoExposureMode(AutoExposureMode mode)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(mode);
+
+  m_video.setAutoExposure(mode == HwSyncCtrlObj::ON);
+}
+
 void SyncCtrlObj::setLatTime(double lat_time)
 {
   DEB_MEMBER_FUNCT();
@@ -26,8 +26,13 @@
 #include <sys/mman.h>
 #include <poll.h>
 #include <unistd.h>
+#include <time.h>
+#include <stdio.h>
+#include <limits.h>
+#include <algorithm>
 #include "V4L2DetInfoCtrlObj.h"
 #include "V4L2VideoCtrlObj.h"
+#include "V4L2Discovery.h"
 
 using namespace lima;
 using namespace lima::V4L2;
@@ -74,6 +79,99 @@ inline bool _from_v4l2_format_2_lima(int v4l_format,VideoMode &mode)
   return found;
 }
 
+// Video modes provided by converting a device format when the camera
+// doesn't deliver them natively, in order of preference.
+struct _EmulatedMode
+{
+  int			v4l2_format;
+  VideoMode		mode;
+  Kernels::Kernel	kernel;
+};
+
+static const _EmulatedMode EmulatedModes[] = {
+  {V4L2_PIX_FMT_YUYV,	Y8,	Kernels::YUYV_2_Y8},
+  {V4L2_PIX_FMT_UYVY,	Y8,	Kernels::UYVY_2_Y8},
+  {V4L2_PIX_FMT_RGB24,	Y8,	Kernels::RGB24_2_Y8},
+  {V4L2_PIX_FMT_Y10P,	Y16,	Kernels::PACKED10_2_Y16},
+  {V4L2_PIX_FMT_SBGGR8,	RGB24,	Kernels::BAYER_BG8_2_RGB24},
+};
+
+// a device format, size and frame interval able to deliver a video mode
+struct _ModeCandidate
+{
+  unsigned int	pixelformat;
+  int		emulated;	// EmulatedModes index, -1 if native
+  bool		decoded;	// converted by libv4l (V4L2_FMT_FLAG_EMULATED)
+  int		width;
+  int		height;
+  struct v4l2_fract interval;	// 0/0 if unknown
+  double	fps;		// of the device, 0 if unknown
+  double	delivered_fps;	// decode cost included
+};
+
+static std::string _fourcc(unsigned int pixelformat)
+{
+  char name[5] = {char(pixelformat & 0xff),char((pixelformat >> 8) & 0xff),
+		  char((pixelformat >> 16) & 0xff),char((pixelformat >> 24) & 0xff),0};
+  return name;
+}
+
+static double _fps(const struct v4l2_fract& interval)
+{
+  return interval.numerator ? double(interval.denominator) / interval.numerator : 0.;
+}
+
+// complete JPEG: starts with SOI, ends with EOI (some cameras pad the
+// payload with zeros after it)
+static bool _is_jpeg_complete(const unsigned char* data,unsigned int size)
+{
+  if(size < 4 || data[0] != 0xff || data[1] != 0xd8)
+    return false;
+  unsigned int end = size;
+  unsigned int min_end = size > 4096 ? size - 4096 : 2;
+  while(end > min_end && !data[end - 1])
+    --end;
+  return end >= 4 && data[end - 2] == 0xff && data[end - 1] == 0xd9;
+}
+
+// V4L2_CID_EXPOSURE_ABSOLUTE is expressed in 100 us units
+inline long long _exp_time_2_v4l2(double exp_time)
+{
+  return (long long)(exp_time * 1e4 + .5);
+}
+
+inline double _v4l2_2_exp_time(long long value)
+{
+  return value * 1e-4;
+}
+
+// bytes of an image handed to Lima, 0 for the modes not published
+inline size_t _video_mode_size(VideoMode mode,int width,int height)
+{
+  size_t nb_pixels = size_t(width) * height;
+  switch(mode)
+    {
+    case Y8: case BAYER_RG8: case BAYER_BG8:
+      return nb_pixels;
+    case Y16: case BAYER_RG16: case BAYER_BG16:
+    case RGB555: case RGB565: case YUV422:
+      return nb_pixels * 2;
+    case RGB24: case BGR24: case YUV444:
+      return nb_pixels * 3;
+    case Y32: case RGB32: case BGR32:
+      return nb_pixels * 4;
+    case Y64:
+      return nb_pixels * 8;
+    case I420: case YUV411:
+      return nb_pixels * 3 / 2;
+    default:
+      return 0;
+    }
+}
+
+// number of recent frames whose exposure time is kept
+static const int EXP_TAG_RING_SIZE = 1024;
+
 class VideoCtrlObj::_AcqThread : public Thread
 {
   DEB_CLASS_NAMESPC(DebModCamera, "VideoCtrlObj", "_AcqThread");
@@ -90,46 +188,150 @@ private:
 
 VideoCtrlObj::VideoCtrlObj(int fd) : 
   m_fd(fd),
+  m_capabilities(fd),
+  m_controls(fd,m_capabilities.getControls()),
+  m_nb_buffers(2),
+  m_streaming(false),
+  m_keep_streaming(false),
+  m_start_time(-1.),
+  m_prepare_time(0.),
+  m_first_frame_delay(-1.),
+  m_buffer_prefault(false),
+  m_mode_switch_time(-1.),
+  m_decode_rate(150e6),
   m_nb_frames(1),
+  m_nb_capture_frames(1),
   m_acq_frame_id(-1),
   m_acq_started(false),
   m_acq_thread_run(false),
   m_quit(false),
   m_live(false),
+  m_trig_mode(IntTrig),
+  m_nb_triggers(0),
+  m_trig_skip(0),
+  m_trig_time(0.),
+  m_last_timestamp(-1.),
+  m_live_latest(true),
+  m_nb_skipped_frames(0),
+  m_display_latency(-1.),
+  m_max_buffer_memory(0),
+  m_buffer_growth(false),
+  m_nb_starvations(0),
+  m_min_queued(-1),
+  m_nb_dropped_frames(0),
+  m_last_sequence(-1),
+  m_frame_timeout(0.),
+  m_reconnect_timeout(10.),
+  m_poll_timeout(-1),
+  m_nb_failures(0),
+  m_nb_stream_restarts(0),
+  m_nb_reconnects(0),
+  m_nb_frame_errors(0),
+  m_acq_error(false),
+  m_corrupt_policy(DropCorruptFrame),
+  m_nb_corrupt_frames(0),
+  m_last_good_width(0),
+  m_last_good_height(0),
+  m_last_good_mode(Y8),
   m_autoexp_supported(false),
-  m_exptime_supported(false)
+  m_exptime_supported(false),
+  m_autoexp_value(V4L2_EXPOSURE_AUTO),
+  m_exp_time(-1.),
+  m_conv_func(NULL),
+  m_conv_mode(Y8),
+  m_conv_src_stride(0),
+  m_bytes_per_line(0),
+  m_pixel_type(Kernels::NbPixelType),
+  m_pixel_max(0),
+  m_stat_active(false),
+  m_exp_latency(2),
+  m_frame_exp_time(-1.),
+  m_exp_sequence_origin(0),
+  m_hdr_active(false),
+  m_hdr_saturation(0),
+  m_hdr_nb_frames(0),
+  m_hdr_nb_images(0),
+  m_hdr_min_exp_time(0.),
+  m_hdr_max_exp_time(0.),
+  m_acc_nb_frames(1),
+  m_acc_average(true),
+  m_acc_count(0),
+  m_ref_capture(NoReference),
+  m_ref_count(0),
+  m_ref_width(0),
+  m_ref_height(0),
+  m_corr_active(false),
+  m_preview_active(false),
+  m_preview_factor(4),
+  m_preview_max_rate(10.),
+  m_preview_time(0.),
+  m_preview_frame_id(-1),
+  m_preview_width(0),
+  m_preview_height(0),
+  m_rec_compressed(false),
+  m_rec_live_rate(5.),
+  m_rec_live_time(0.),
+  m_stream_compressed(false),
+  m_decoder(NULL),
+  m_metadata_found(false)
 {
   DEB_CONSTRUCTOR();
 
+  memset(&m_last_stat,0,sizeof(m_last_stat));
+  memset(&m_rec_format,0,sizeof(m_rec_format));
+  memset(&m_stream_format,0,sizeof(m_stream_format));
+  memset(&m_decode_format,0,sizeof(m_decode_format));
+  memset(&m_path,0,sizeof(m_path));
+  memset(&m_acq_format,0,sizeof(m_acq_format));
+  memset(&m_acq_parm,0,sizeof(m_acq_parm));
+  _ExpTag no_tag = {-1,-1.,false};
+  m_exp_tags.assign(EXP_TAG_RING_SIZE,no_tag);
+  MetadataStream::Frame no_metadata;
+  memset(&no_metadata,0,sizeof(no_metadata));
+  no_metadata.frame_id = -1;
+  m_frame_metadata.assign(EXP_TAG_RING_SIZE,no_metadata);
+  m_metadata_frame = no_metadata;
   memset(&m_buffer,0,sizeof(m_buffer));
   m_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  for (unsigned int i = 0;i < sizeof(m_buffers) / sizeof(unsigned char*);++i)
-    m_buffers[i] = NULL;
-
-  struct v4l2_capability cap;
-  int ret = v4l2_ioctl(m_fd, VIDIOC_QUERYCAP, &cap);
 
-  if(ret == -1) 
-    THROW_HW_ERROR(Error) << "Error querying cap: " << strerror(errno);
+  const struct v4l2_capability& cap = m_capabilities.getCapability();
+  CapabilityCache::Data& caps = m_capabilities.getData();
+  bool cached = m_capabilities.isHit();
+  int ret;
 
   DEB_TRACE() << DEB_VAR1(cap.driver) << ","
 	      << DEB_VAR1(cap.card) << ","
 	      << DEB_VAR1(cap.bus_info);
 
   m_det_model = (char*)cap.card;
+  // to find the device again if it is disconnected
+  m_bus_info = (char*)cap.bus_info;
+  char fd_link[64],dev_path[PATH_MAX];
+  snprintf(fd_link,sizeof(fd_link),"/proc/self/fd/%d",fd);
+  ssize_t path_len = readlink(fd_link,dev_path,sizeof(dev_path) - 1);
+  if(path_len > 0)
+    m_dev_path.assign(dev_path,path_len);
   if(!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE))
     THROW_HW_ERROR(Error) << "Error: dev. doesn't have VIDEO_CAPTURE cap.";
 
-  struct v4l2_fmtdesc formatdesc;
+  if(!cached)
+    {
+      struct v4l2_fmtdesc formatdesc;
+      formatdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      for(formatdesc.index = 0;v4l2_ioctl(m_fd, VIDIOC_ENUM_FMT, &formatdesc) != -1;
+	  ++formatdesc.index)
+	caps.formats.push_back(formatdesc.pixelformat);
+    }
 
-  formatdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  for(formatdesc.index = 0;v4l2_ioctl(m_fd, VIDIOC_ENUM_FMT, &formatdesc) != -1;
-      ++formatdesc.index)
+  std::set<int> device_formats;
+  for(unsigned f = 0;f < caps.formats.size();++f)
     {
+      unsigned int pixelformat = caps.formats[f];
+      device_formats.insert(pixelformat);
       VideoMode lima_video_mode;
-      if(_from_v4l2_format_2_lima(formatdesc.pixelformat,lima_video_mode))
+      if(_from_v4l2_format_2_lima(pixelformat,lima_video_mode))
 	m_available_format.insert(lima_video_mode);
-      switch(formatdesc.pixelformat)
+      switch(pixelformat)
 	{
 	  /* RGB formats */
 	case V4L2_PIX_FMT_RGB332: 	DEB_TRACE() << "As V4L2_PIX_FMT_RGB332";break;
@@ -215,6 +417,19 @@ VideoCtrlObj::VideoCtrlObj(int fd) :
 	}
     }
 
+  for(unsigned i = 0;i < sizeof(EmulatedModes) / sizeof(_EmulatedMode);++i)
+    {
+      const _EmulatedMode& emulated = EmulatedModes[i];
+      if(device_formats.find(emulated.v4l2_format) == device_formats.end() ||
+	 m_available_format.find(emulated.mode) != m_available_format.end())
+	continue;
+      DEB_TRACE() << "Emulate " << DEB_VAR1(emulated.mode) << " with "
+		  << Kernels::getKernelName(emulated.kernel) << " ("
+		  << Kernels::getSimdLevelName(Kernels::getSimdLevel()) << ")";
+      m_available_format.insert(emulated.mode);
+      m_emulated_format[emulated.mode] = i;
+    }
+
   VideoMode PreferredVideoMode[] ={BAYER_BG8,BAYER_BG16,
 				   I420,YUV411,YUV422,YUV444,
 				   RGB555,RGB565,
@@ -236,13 +451,20 @@ VideoCtrlObj::VideoCtrlObj(int fd) :
   
   setVideoMode(start_video_mode);
 
-  struct v4l2_streamparm streamparm;
-  streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  ret = v4l2_ioctl(m_fd,VIDIOC_G_PARM,&streamparm);
-  if(ret == -1)
-    THROW_HW_ERROR(Error) << "Error querying stream param : " << strerror(errno);
+  if(!cached)
+    {
+      struct v4l2_streamparm streamparm;
+      streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      ret = v4l2_ioctl(m_fd,VIDIOC_G_PARM,&streamparm);
+      if(ret == -1)
+	THROW_HW_ERROR(Error) << "Error querying stream param : " << strerror(errno);
+      caps.time_per_frame = streamparm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME;
+    }
 
-  if(streamparm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)
+  // the frame intervals are only traced, not walked again from the cache
+  if(caps.time_per_frame && cached)
+    DEB_ALWAYS() << "Time per frame supported";
+  else if(caps.time_per_frame)
     {
       DEB_ALWAYS() << "Time per frame supported";
       struct v4l2_format format;
@@ -280,16 +502,42 @@ VideoCtrlObj::VideoCtrlObj(int fd) :
     DEB_ALWAYS() << "Time per frame NOT supported";    
   }
      
-  struct v4l2_control ctrl;
-  ctrl.id = V4L2_CID_EXPOSURE_AUTO;
-  ctrl.value = V4L2_EXPOSURE_AUTO;
-  ret = v4l2_ioctl(m_fd,VIDIOC_S_CTRL,&ctrl);
-  if(ret == -1) {
-    m_autoexp_supported = false;
+  // exposure capabilities come from the control cache, many UVC cameras
+  // only provide the aperture priority mode as automatic exposure
+  m_exptime_supported = m_controls.isSupported(V4L2_CID_EXPOSURE_ABSOLUTE);
+  if(!m_exptime_supported)
+    DEB_WARNING() << "Exposure control not supported";
+
+  if(cached)
+    m_autoexp_value = caps.autoexp_value;
+  else if(m_controls.isMenuItemSupported(V4L2_CID_EXPOSURE_AUTO,V4L2_EXPOSURE_AUTO))
+    m_autoexp_value = V4L2_EXPOSURE_AUTO;
+  else if(m_controls.isMenuItemSupported(V4L2_CID_EXPOSURE_AUTO,V4L2_EXPOSURE_APERTURE_PRIORITY))
+    m_autoexp_value = V4L2_EXPOSURE_APERTURE_PRIORITY;
+  else
+    m_autoexp_value = -1;
+  m_autoexp_supported = m_autoexp_value != -1;
+  if(m_autoexp_supported)
+    {
+      try
+	{
+	  setAutoExposure(true);
+	}
+      catch(Exception&)
+	{
+	  m_autoexp_supported = false;
+	}
+    }
+  if(!m_autoexp_supported)
     DEB_WARNING() << "Auto Exposure NOT supported";
-  } else {
-    m_autoexp_supported = true;
-  }
+
+  if(!cached)
+    {
+      caps.autoexp_value = m_autoexp_supported ? m_autoexp_value : -1;
+      m_controls.getInfos(caps.controls);
+      m_capabilities.save();
+    }
+
   if(pipe(m_pipes))
     THROW_HW_ERROR(Error) << "Can't open pipe";
 
@@ -311,10 +559,14 @@ VideoCtrlObj::~VideoCtrlObj()
   delete m_acq_thread;
   close(m_pipes[0]);
 
-  for(unsigned i = 0;i < sizeof(m_buffers) / sizeof(unsigned char*);++i)
+  _streamOff();
+  for(unsigned i = 0;i < m_buffers.size();++i)
     if(v4l2_munmap(m_buffers[i], m_buffer.length))
       DEB_ERROR() << "unmapping error: " << strerror(errno);
 
+  if(m_decoder)
+    v4lconvert_destroy(m_decoder);
+  _closeRetiredFds();
   v4l2_close(m_fd);
 }
 
@@ -336,11 +588,7 @@ void VideoCtrlObj::getMaxImageSize(Size& max_size)
   DEB_MEMBER_FUNCT();
   
   struct v4l2_format format;
-  
-  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  int ret = v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format);
-  if(ret == -1)
-    THROW_HW_ERROR(Error) << "Can't get the format: " << strerror(errno);
+  _getFormat(format);
 
   max_size = Size(format.fmt.pix.width,format.fmt.pix.height);
   DEB_RETURN() << DEB_VAR1(max_size);
@@ -351,13 +599,15 @@ void VideoCtrlObj::getCurrImageType(ImageType& image_format)
   DEB_MEMBER_FUNCT();
 
   struct v4l2_format format;
+  _getFormat(format);
   
-  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  int ret = v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format);
-  if(ret == -1)
-    THROW_HW_ERROR(Error) << "Can't get the format: " << strerror(errno);
-  
-  switch(format.fmt.pix.pixelformat)
+  if(_isY32Output())
+    image_format = Bpp32;
+  else if(m_corr_active)
+    image_format = Bpp16;
+  else if(m_conv_func)
+    image_format = m_conv_mode == Y16 ? Bpp16 : Bpp8;
+  else switch(format.fmt.pix.pixelformat)
     {
     case V4L2_PIX_FMT_Y16:
     case V4L2_PIX_FMT_SBGGR16:
@@ -415,17 +665,13 @@ void VideoCtrlObj::getMinMaxExpTime(double& min,double& max)
 {
   DEB_MEMBER_FUNCT();
   
-  struct v4l2_queryctrl query;
-  query.id = V4L2_CID_EXPOSURE_ABSOLUTE;
-  int ret = v4l2_ioctl(m_fd,VIDIOC_QUERYCTRL,&query);
-  if(ret == -1) {
-    DEB_WARNING() << "Exposure control not supported";
-    m_exptime_supported = false;
+  if(!m_exptime_supported) {
     // open the range and ignore new settings
     min=0; max=1e6;
   } else {
-    m_exptime_supported = true;
-    min = 1 / (query.maximum * 5.),max = 1 / (query.minimum * 5.);
+    long long min_value,max_value;
+    m_controls.getRange(V4L2_CID_EXPOSURE_ABSOLUTE,min_value,max_value);
+    min = _v4l2_2_exp_time(std::max(min_value,1LL)),max = _v4l2_2_exp_time(max_value);
     DEB_RETURN() << DEB_VAR2(min,max);
   }    
 }
@@ -435,13 +681,8 @@ void VideoCtrlObj::getExpTime(double &exp_time)
   DEB_MEMBER_FUNCT();
 
   if (m_exptime_supported) {
-    struct v4l2_control ctrl;
-    ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
-    int ret = v4l2_ioctl(m_fd,VIDIOC_G_CTRL,&ctrl);
-    if(ret == -1)
-      THROW_HW_ERROR(Error) << "Can't get exposure time " << strerror(errno);
-    
-    exp_time = 1 / (ctrl.value * 5.); // Fixed me!!!
+    long long value = m_controls.getValue(V4L2_CID_EXPOSURE_ABSOLUTE);
+    exp_time = _v4l2_2_exp_time(value);
   } else {
     DEB_WARNING() << "Exposure control not supported, just ignore value !!";
   }
@@ -454,12 +695,8 @@ void VideoCtrlObj::setExpTime(double exp_time)
   DEB_PARAM() << DEB_VAR1(exp_time);
 
   if (m_exptime_supported) {
-    struct v4l2_control ctrl;
-    ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
-    ctrl.value = 5 / exp_time ;
-    int ret = v4l2_ioctl(m_fd,VIDIOC_S_CTRL,&ctrl);
-    if(ret == -1)
-      THROW_HW_ERROR(Error) << "Can't set exposure time" << strerror(errno);
+    m_controls.setValue(V4L2_CID_EXPOSURE_ABSOLUTE,_exp_time_2_v4l2(exp_time));
+    m_exp_time = exp_time;
   } else {
     DEB_WARNING() << "Exposure control not supported, just ignore value !!";
   }
@@ -478,264 +715,2633 @@ void VideoCtrlObj::getNbHwFrames(int &nb_frames)
   nb_frames = m_nb_frames;
 }
 
-void VideoCtrlObj::reset(HwInterface::ResetLevel)
+void VideoCtrlObj::setTrigMode(TrigMode trig_mode)
 {
   DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(trig_mode);
 
-  THROW_HW_ERROR(NotSupported) << "Not implemented yet";
-}
-
+  if(trig_mode != IntTrig && trig_mode != IntTrigMult)
+    THROW_HW_ERROR(NotSupported) << DEB_VAR1(trig_mode) << " is not supported";
 
-// Acq
-////////
+  AutoMutex aLock(m_cond.mutex());
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the trigger mode during acquisition";
+  m_trig_mode = trig_mode;
+}
 
-void VideoCtrlObj::prepareAcq()
+void VideoCtrlObj::getTrigMode(TrigMode& trig_mode) const
 {
-  DEB_MEMBER_FUNCT();
-  m_acq_frame_id = -1;
-  
-  
-  // If VIDIOC_QBUF called, stream must be set on/off before new buffer query
-  // The only trick I find to make it works !!
-  enum v4l2_buf_type buff_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  if(v4l2_ioctl(m_fd,VIDIOC_STREAMON,&buff_type) == -1)
-    THROW_HW_ERROR(Error) << "Error starting stream : " << strerror(errno);
-  
-  if(v4l2_ioctl(m_fd,VIDIOC_STREAMOFF,&buff_type) == -1)
-    DEB_ERROR() << "Error stopping stream : " << strerror(errno);
-  for(unsigned i = 0;
-      i < sizeof(m_buffers) / sizeof(unsigned char*);++i)
-    {
-      m_buffer.index = i;
-      int ret = v4l2_ioctl(m_fd,VIDIOC_QBUF,&m_buffer);
-      if(ret == -1)
-	THROW_HW_ERROR(Error) << "Error queue buff " << strerror(errno);
-      if(m_nb_frames && i > unsigned(m_nb_frames)) break;
-    }
+  trig_mode = m_trig_mode;
 }
 
-void VideoCtrlObj::startAcq()
+void VideoCtrlObj::setNbBuffers(int nb_buffers)
 {
   DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_buffers);
 
-  enum v4l2_buf_type buff_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  if(v4l2_ioctl(m_fd,VIDIOC_STREAMON,&buff_type) == -1)
-    THROW_HW_ERROR(Error) << "Error starting stream : " << strerror(errno);
+  if(nb_buffers < 2)
+    THROW_HW_ERROR(InvalidValue) << "At least 2 buffers are needed";
 
   AutoMutex aLock(m_cond.mutex());
-  m_acq_started = true;
-  m_cond.broadcast();
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the number of buffers during acquisition";
+  m_nb_buffers = nb_buffers;
+  _unmap();
+  _map();
+}
 
+void VideoCtrlObj::getNbBuffers(int& nb_buffers) const
+{
+  nb_buffers = m_buffers.size();
 }
 
-void VideoCtrlObj::stopAcq()
+void VideoCtrlObj::setLiveLatestFrame(bool active)
 {
   DEB_MEMBER_FUNCT();
-
-  AutoMutex aLock(m_cond.mutex());
-  m_acq_started = false;
-  write(m_pipes[1],"|",1);
-  aLock.unlock();
+  DEB_PARAM() << DEB_VAR1(active);
+  m_live_latest = active;
 }
 
-void VideoCtrlObj::getStatus(HwInterface::StatusType& status)
+void VideoCtrlObj::getLiveLatestFrame(bool& active) const
 {
-  status.set(m_acq_thread_run ? HwInterface::StatusType::Exposure : HwInterface::StatusType::Ready);
+  active = m_live_latest;
 }
 
-int VideoCtrlObj::getNbHwAcquiredFrames()
+void VideoCtrlObj::getDisplayLatency(double& latency)
 {
   DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  latency = m_display_latency;
+  DEB_RETURN() << DEB_VAR1(latency);
+}
 
-  return m_acq_frame_id + 1;
+void VideoCtrlObj::getNbSkippedFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  nb_frames = m_nb_skipped_frames;
+  DEB_RETURN() << DEB_VAR1(nb_frames);
 }
-// Acquisition thread
-//////////////////////
 
-VideoCtrlObj::_AcqThread::_AcqThread(VideoCtrlObj& aVideo) :
-  m_video(aVideo)
+void VideoCtrlObj::setFrameTimeout(double timeout)
 {
-  pthread_attr_setscope(&m_thread_attr,PTHREAD_SCOPE_PROCESS);
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(timeout);
+  m_frame_timeout = timeout;
 }
 
+void VideoCtrlObj::getFrameTimeout(double& timeout) const
+{
+  timeout = m_frame_timeout;
+}
 
-void VideoCtrlObj::getSupportedVideoMode(std::list<VideoMode>& aList) const
+void VideoCtrlObj::setReconnectTimeout(double timeout)
 {
   DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(timeout);
 
-  for(std::set<VideoMode>::iterator i = m_available_format.begin();
-      i != m_available_format.end();++i)
-    aList.push_back(*i);
+  if(timeout < 0.)
+    THROW_HW_ERROR(InvalidValue) << "The reconnect timeout can't be negative";
+  m_reconnect_timeout = timeout;
 }
 
+void VideoCtrlObj::getReconnectTimeout(double& timeout) const
+{
+  timeout = m_reconnect_timeout;
+}
 
-void VideoCtrlObj::setVideoMode(VideoMode mode)
+void VideoCtrlObj::getNbStreamRestarts(int& nb_restarts)
 {
   DEB_MEMBER_FUNCT();
-  DEB_PARAM() << DEB_VAR1(mode);
-
-  struct v4l2_format format;
-  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  int ret = v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format);
-  if(ret == -1)
-    THROW_HW_ERROR(Error) << "Can't get the format: " << strerror(errno);
+  AutoMutex aLock(m_cond.mutex());
+  nb_restarts = m_nb_stream_restarts;
+  DEB_RETURN() << DEB_VAR1(nb_restarts);
+}
 
-  switch(mode)
-    {
-    case Y8:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;		break;
-    case Y16:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_Y16;		break;
+void VideoCtrlObj::getNbReconnects(int& nb_reconnects)
+{
+  DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  nb_reconnects = m_nb_reconnects;
+  DEB_RETURN() << DEB_VAR1(nb_reconnects);
+}
 
-    case RGB555:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB555;	break;
-    case RGB565:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB565;	break;
-    case RGB24:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;	break;
-    case RGB32:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB32;	break;
-    case BGR24:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_BGR24;	break;
-    case BGR32:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_BGR32;	break;
+void VideoCtrlObj::getNbFrameErrors(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  nb_frames = m_nb_frame_errors;
+  DEB_RETURN() << DEB_VAR1(nb_frames);
+}
 
-    case BAYER_BG8:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_SBGGR8;	break;
-    case BAYER_BG16:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_SBGGR16;	break;
+void VideoCtrlObj::setCorruptFramePolicy(CorruptFramePolicy policy)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(policy);
 
-    case I420:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;	break;
-    case YUV411:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV411P;	break;
-    case YUV422:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV422P;	break;
-    default:
-      THROW_HW_ERROR(NotSupported) << "Not implemented yet!";
-    }
+  AutoMutex aLock(m_cond.mutex());
+  m_corrupt_policy = policy;
+  m_last_good.clear();
+}
 
-  _unmap();
-  ret = v4l2_ioctl(m_fd,VIDIOC_S_FMT,&format);
-  if(ret == -1)
-    THROW_HW_ERROR(Error) << "Can't set the format: " << strerror(errno);
-  _map();
+void VideoCtrlObj::getCorruptFramePolicy(CorruptFramePolicy& policy) const
+{
+  policy = m_corrupt_policy;
 }
 
-void VideoCtrlObj::getVideoMode(VideoMode& mode) const
+void VideoCtrlObj::getNbCorruptFrames(int& nb_frames)
 {
   DEB_MEMBER_FUNCT();
-  
-  struct v4l2_format format;
-  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  int ret = v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format);
-  if(ret == -1)
-    THROW_HW_ERROR(Error) << "Can't get the format: " << strerror(errno);
-  
-  _from_v4l2_format_2_lima(format.fmt.pix.pixelformat,mode);
-  DEB_RETURN() << DEB_VAR1(mode);
+  AutoMutex aLock(m_cond.mutex());
+  nb_frames = m_nb_corrupt_frames;
+  DEB_RETURN() << DEB_VAR1(nb_frames);
 }
 
-void VideoCtrlObj::setLive(bool start_flag)
+void VideoCtrlObj::getFrameCorrupt(int frame_id,bool& corrupt)
 {
   DEB_MEMBER_FUNCT();
-  DEB_PARAM() << DEB_VAR1(start_flag);
+  DEB_PARAM() << DEB_VAR1(frame_id);
 
-  m_live = start_flag;
-  if(start_flag)			// start
-    {
+  AutoMutex aLock(m_cond.mutex());
+  const _ExpTag& tag = m_exp_tags[std::max(frame_id,0) % m_exp_tags.size()];
+  if(frame_id < 0 || tag.frame_id != frame_id)
+    THROW_HW_ERROR(InvalidValue) << "Frame " << frame_id << " is not known";
+  corrupt = tag.corrupt;
 
-      setNbHwFrames(0);
-      
-      // prepare to request buffers
-      prepareAcq();
+  DEB_RETURN() << DEB_VAR1(corrupt);
+}
 
+void VideoCtrlObj::setMaxBufferMemory(int mbytes)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(mbytes);
 
-      enum v4l2_buf_type buff_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      if(v4l2_ioctl(m_fd,VIDIOC_STREAMON,&buff_type) == -1)
-	THROW_HW_ERROR(Error) << "Error starting stream : " << strerror(errno);
+  if(mbytes < 0)
+    THROW_HW_ERROR(InvalidValue) << "The buffer memory can't be negative";
+  m_max_buffer_memory = mbytes;
+}
 
-      AutoMutex aLock(m_cond.mutex());
-      m_acq_started = true;
-      m_cond.broadcast();
-    }
-  else
-    {
-      AutoMutex aLock(m_cond.mutex());
-      m_acq_started = false;
-      write(m_pipes[1],"|",1);
-      aLock.unlock();
-    }
+void VideoCtrlObj::getMaxBufferMemory(int& mbytes) const
+{
+  mbytes = m_max_buffer_memory;
 }
 
-void VideoCtrlObj::getLive(bool &flag) const
+void VideoCtrlObj::getNbStarvations(int& nb_starvations)
 {
   DEB_MEMBER_FUNCT();
-  flag = m_live;
+  AutoMutex aLock(m_cond.mutex());
+  nb_starvations = m_nb_starvations;
+  DEB_RETURN() << DEB_VAR1(nb_starvations);
 }
 
-void VideoCtrlObj::getGain(double &gain) const
+void VideoCtrlObj::getMinQueuedBuffers(int& nb_buffers)
 {
-  gain = m_gain;
+  DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  nb_buffers = m_min_queued;
+  DEB_RETURN() << DEB_VAR1(nb_buffers);
 }
 
-void VideoCtrlObj::setGain(double gain)
+void VideoCtrlObj::getNbDroppedFrames(int& nb_frames)
 {
-  m_gain = gain;
+  DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  nb_frames = m_nb_dropped_frames;
+  DEB_RETURN() << DEB_VAR1(nb_frames);
 }
 
-void VideoCtrlObj::checkBin(Bin& bin)
+void VideoCtrlObj::setAccNbFrames(int nb_frames)
 {
-  bin = Bin(1,1);		// Do not manage Hw Bin
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  // the sums must stay below 2^31
+  if(nb_frames < 1 || nb_frames > 32768)
+    THROW_HW_ERROR(InvalidValue) << "Number of accumulated frames must be in [1,32768]";
+  if(nb_frames > 1 && m_pixel_type == Kernels::NbPixelType)
+    THROW_HW_ERROR(NotSupported) << "Frame accumulation is only available in Y8 and Y16 video modes";
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the accumulation during acquisition";
+  m_acc_nb_frames = nb_frames;
 }
 
-void VideoCtrlObj::checkRoi(const Roi&, Roi& hw_roi)
+void VideoCtrlObj::getAccNbFrames(int& nb_frames) const
 {
-  Size size;
-  getMaxImageSize(size);
-  hw_roi = Roi(0,0,size.getWidth(),size.getHeight()); // Do not manage Hw Roi
+  nb_frames = m_acc_nb_frames;
 }
 
-bool VideoCtrlObj::checkAutoGainMode(AutoGainMode mode) const
+void VideoCtrlObj::setAccAverage(bool average)
 {
-  return true;
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(average);
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the accumulation during acquisition";
+  m_acc_average = average;
 }
 
-void VideoCtrlObj::setHwAutoGainMode(AutoGainMode mode)
+void VideoCtrlObj::getAccAverage(bool& average) const
 {
+  average = m_acc_average;
 }
 
-bool VideoCtrlObj::isAutoExposureSupported()
+void VideoCtrlObj::setCorrectionActive(bool active)
 {
   DEB_MEMBER_FUNCT();
-  return m_autoexp_supported;
+  DEB_PARAM() << DEB_VAR1(active);
+
+  if(active && m_pixel_type == Kernels::NbPixelType)
+    THROW_HW_ERROR(NotSupported) << "Correction is only available in Y8 and Y16 video modes";
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the correction during acquisition";
+  m_corr_active = active;
 }
 
-void VideoCtrlObj::_unmap()
+void VideoCtrlObj::getCorrectionActive(bool& active) const
+{
+  active = m_corr_active;
+}
+
+void VideoCtrlObj::setReferenceCapture(Reference ref)
 {
   DEB_MEMBER_FUNCT();
-  if(!m_buffers[0]) return;			// nothing to free
+  DEB_PARAM() << DEB_VAR1(ref);
 
-  for(unsigned i = 0;i < sizeof(m_buffers) / sizeof(unsigned char*);++i)
-    {
-      if(m_buffers[i])
-	{
-	  if(v4l2_munmap(m_buffers[i], m_buffer.length))
-	    DEB_ERROR() << "unmapping error: " << strerror(errno);
-	  m_buffers[i] = NULL;
-	}
-    }
+  if(ref != NoReference && m_pixel_type == Kernels::NbPixelType)
+    THROW_HW_ERROR(NotSupported) << "References are only available in Y8 and Y16 video modes";
 
-  struct v4l2_requestbuffers requestbuff;
-  requestbuff.count = 0;
-  requestbuff.type = m_buffer.type;
-  requestbuff.memory = V4L2_MEMORY_MMAP;
-  int ret = v4l2_ioctl(m_fd,VIDIOC_REQBUFS,&requestbuff);
-  if(ret == -1)
-    THROW_HW_ERROR(Error) << "req. buffers: " << strerror(errno);
+  AutoMutex aLock(m_cond.mutex());
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the reference capture during acquisition";
+  _endReferenceCapture();
+  m_ref_capture = ref;
 }
 
-void VideoCtrlObj::_map()
+void VideoCtrlObj::getReferenceCapture(Reference& ref) const
 {
-  DEB_MEMBER_FUNCT();
+  ref = m_ref_capture;
+}
+
+void VideoCtrlObj::loadReference(Reference ref,const std::string& path)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(ref,path);
+
+  if(ref == NoReference)
+    THROW_HW_ERROR(InvalidValue) << "Invalid reference";
+
+  Size size;
+  _getProcessedSize(size);
+  int width = size.getWidth(),height = size.getHeight();
+  size_t nb_pixels = size_t(width) * height;
+
+  FILE* file = fopen(path.c_str(),"rb");
+  if(!file)
+    THROW_HW_ERROR(Error) << "Can't open " << path << ": " << strerror(errno);
+  fseek(file,0,SEEK_END);
+  long file_size = ftell(file);
+  fseek(file,0,SEEK_SET);
+
+  std::vector<float> data(nb_pixels);
+  size_t nb_read = 0;
+  if(file_size == long(nb_pixels * sizeof(float)))
+    nb_read = fread(&data[0],sizeof(float),nb_pixels,file);
+  else if(file_size == long(nb_pixels * sizeof(unsigned short)))
+    {
+      std::vector<unsigned short> raw(nb_pixels);
+      nb_read = fread(&raw[0],sizeof(unsigned short),nb_pixels,file);
+      std::copy(raw.begin(),raw.end(),data.begin());
+    }
+  fclose(file);
+  if(nb_read != nb_pixels)
+    THROW_HW_ERROR(Error) << path << " is not a " << width << "x" << height
+			  << " float32 or uint16 image";
+
+  AutoMutex aLock(m_cond.mutex());
+  _Reference& reference = m_refs[ref];
+  reference.width = width,reference.height = height;
+  reference.data.swap(data);
+}
+
+void VideoCtrlObj::saveReference(Reference ref,const std::string& path)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(ref,path);
+
+  AutoMutex aLock(m_cond.mutex());
+  if(ref == NoReference || m_refs[ref].data.empty())
+    THROW_HW_ERROR(Error) << "No reference image to save";
+
+  const std::vector<float>& data = m_refs[ref].data;
+  FILE* file = fopen(path.c_str(),"wb");
+  if(!file)
+    THROW_HW_ERROR(Error) << "Can't open " << path << ": " << strerror(errno);
+  size_t nb_written = fwrite(&data[0],sizeof(float),data.size(),file);
+  if(fclose(file) || nb_written != data.size())
+    THROW_HW_ERROR(Error) << "Can't write " << path << ": " << strerror(errno);
+}
+
+void VideoCtrlObj::clearReference(Reference ref)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(ref);
+
+  AutoMutex aLock(m_cond.mutex());
+  m_refs[ref].data.clear();
+}
+
+void VideoCtrlObj::setPreviewActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  if(active && m_pixel_type == Kernels::NbPixelType)
+    THROW_HW_ERROR(NotSupported) << "Preview is only available in Y8 and Y16 video modes";
+
+  AutoMutex aLock(m_cond.mutex());
+  m_preview_active = active;
+  m_preview_frame_id = -1;
+}
+
+void VideoCtrlObj::getPreviewActive(bool& active) const
+{
+  active = m_preview_active;
+}
+
+void VideoCtrlObj::setPreviewFactor(int factor)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(factor);
+
+  if(factor < 1 || factor > 64)
+    THROW_HW_ERROR(InvalidValue) << "Preview factor must be in [1,64]";
+
+  AutoMutex aLock(m_cond.mutex());
+  m_preview_factor = factor;
+}
+
+void VideoCtrlObj::getPreviewFactor(int& factor) const
+{
+  factor = m_preview_factor;
+}
+
+void VideoCtrlObj::setPreviewMaxRate(double max_rate)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(max_rate);
+
+  if(max_rate < 0.)
+    THROW_HW_ERROR(InvalidValue) << "Invalid preview rate: " << max_rate;
+
+  AutoMutex aLock(m_cond.mutex());
+  m_preview_max_rate = max_rate;
+}
+
+void VideoCtrlObj::getPreviewMaxRate(double& max_rate) const
+{
+  max_rate = m_preview_max_rate;
+}
+
+void VideoCtrlObj::getPreviewImage(int& frame_id,int& width,int& height,int& depth,
+				   std::vector<unsigned char>& data)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_preview_frame_id < 0)
+    THROW_HW_ERROR(Error) << "No preview available";
+
+  frame_id = m_preview_frame_id;
+  width = m_preview_width,height = m_preview_height;
+  depth = m_preview_buffer.size() / (size_t(width) * height);
+  data = m_preview_buffer;
+
+  DEB_RETURN() << DEB_VAR4(frame_id,width,height,depth);
+}
+
+void VideoCtrlObj::reset(HwInterface::ResetLevel)
+{
+  DEB_MEMBER_FUNCT();
+
+  THROW_HW_ERROR(NotSupported) << "Not implemented yet";
+}
+
+
+// Acq
+////////
+
+void VideoCtrlObj::prepareAcq()
+{
+  DEB_MEMBER_FUNCT();
+  {
+    AutoMutex aLock(m_cond.mutex());
+    _closeRetiredFds();
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  m_prepare_time = now.tv_sec + now.tv_nsec * 1e-9;
+  m_first_frame_delay = -1.;
+  __atomic_store_n(&m_acq_frame_id,-1,__ATOMIC_RELEASE);
+  _prepareExposure();
+
+  if(m_hdr_active)
+    {
+      if(m_exp_bracket.empty() || m_pixel_type == Kernels::NbPixelType)
+	THROW_HW_ERROR(Error) << "HDR merge needs an exposure bracket and a Y8 or Y16 video mode";
+      if(m_acc_nb_frames > 1)
+	THROW_HW_ERROR(Error) << "HDR merge and frame accumulation can't be combined";
+      m_hdr_nb_frames = 0;
+      __atomic_store_n(&m_hdr_nb_images,0,__ATOMIC_RELEASE);
+    }
+  else if(m_acc_nb_frames > 1)
+    {
+      if(m_pixel_type == Kernels::NbPixelType)
+	THROW_HW_ERROR(Error) << "Frame accumulation needs a Y8 or Y16 video mode";
+      m_acc_count = 0;
+    }
+  m_nb_capture_frames = m_nb_frames * _getNbFramesPerImage();
+  _prepareCorrection();
+  _prepareFramePath();
+
+  if(m_recorder.isOpen())
+    {
+      struct v4l2_format format;
+      memset(&format,0,sizeof(format));
+      format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      if(v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format) == -1)
+	THROW_HW_ERROR(Error) << "Can't get format: " << strerror(errno);
+      AutoMutex aLock(m_cond.mutex());
+      m_rec_format = format.fmt.pix;
+    }
+
+  AutoMutex aLock(m_cond.mutex());
+  // the buffers still queued (kept stream, prepareAcq without startAcq)
+  // are reused, the frames already captured by a kept stream are dropped
+  if(m_streaming)
+    _flushStream();
+  for(unsigned i = 0;i < m_buffers.size();++i)
+    if(!m_buffer_queued[i])
+      {
+	m_buffer.index = i;
+	if(!_queueBuffer(m_buffer))
+	  THROW_HW_ERROR(Error) << "Error queue buff " << strerror(errno);
+      }
+
+  __atomic_store_n(&m_nb_triggers,0,__ATOMIC_RELEASE);
+  m_last_timestamp = -1.;
+  m_nb_skipped_frames = 0;
+  m_display_latency = -1.;
+  m_nb_starvations = 0;
+  m_min_queued = -1;
+  m_nb_dropped_frames = 0;
+  m_last_sequence = -1;
+  m_nb_failures = 0;
+  m_nb_stream_restarts = 0;
+  m_nb_reconnects = 0;
+  m_nb_frame_errors = 0;
+  m_nb_corrupt_frames = 0;
+  m_last_good.clear();
+  // the frame ids start again from 0, like the exposure tags
+  for(size_t i = 0;i < m_frame_metadata.size();++i)
+    m_frame_metadata[i].frame_id = -1;
+  __atomic_store_n(&m_acq_error,false,__ATOMIC_RELEASE);
+
+  // what a reopened device is set back to, and the frame deadline
+  m_acq_format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_G_FMT,&m_acq_format) == -1)
+    THROW_HW_ERROR(Error) << "Can't get format: " << strerror(errno);
+  m_acq_parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_G_PARM,&m_acq_parm) == -1)
+    memset(&m_acq_parm.parm,0,sizeof(m_acq_parm.parm));
+  if(m_frame_timeout < 0.)
+    m_poll_timeout = -1;
+  else
+    {
+      double timeout = m_frame_timeout;
+      if(!timeout)
+	{
+	  double interval = _fps(m_acq_parm.parm.capture.timeperframe);
+	  interval = interval > 0. ? 1. / interval : 0.;
+	  // the longest exposure of the bracket sets the frame pace
+	  double exp_time = m_exp_time;
+	  if(!m_exp_bracket.empty())
+	    exp_time = *std::max_element(m_exp_bracket.begin(),m_exp_bracket.end());
+	  timeout = std::max(1.,5 * std::max(interval,exp_time));
+	}
+      m_poll_timeout = int(timeout * 1e3);
+    }
+  DEB_TRACE() << "Frame timeout (ms) : " << m_poll_timeout;
+  // the buffers of the formats converted by libv4l2 are its own
+  m_buffer_growth = m_max_buffer_memory > 0 && !m_stream_compressed;
+  if(m_buffer_growth)
+    {
+      struct v4l2_format format;
+      format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      struct v4l2_fmtdesc desc;
+      memset(&desc,0,sizeof(desc));
+      desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      if(v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format) == -1)
+	m_buffer_growth = false;
+      for(desc.index = 0;m_buffer_growth && v4l2_ioctl(m_fd,VIDIOC_ENUM_FMT,&desc) != -1;
+	  ++desc.index)
+	if(desc.pixelformat == format.fmt.pix.pixelformat &&
+	   (desc.flags & V4L2_FMT_FLAG_EMULATED))
+	  m_buffer_growth = false;
+      if(!m_buffer_growth)
+	DEB_WARNING() << "The buffers of this format can't grow";
+    }
+  if(_isTrigMult())
+    {
+      // the stream stays armed, startAcq only triggers, so a snap doesn't
+      // pay the stream start nor the sensor warm-up frames
+      _streamOn();
+      m_acq_started = true;
+      m_cond.broadcast();
+    }
+}
+
+void VideoCtrlObj::startAcq()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(_isTrigMult())
+    {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      AutoMutex aLock(m_cond.mutex());
+      if(!m_acq_started)
+	THROW_HW_ERROR(Error) << "Acquisition is not prepared";
+      m_trig_time = now.tv_sec + now.tv_nsec * 1e-9;
+      m_trig_skip = 1;
+      __atomic_add_fetch(&m_nb_triggers,1,__ATOMIC_RELEASE);
+      return;
+    }
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_streaming)
+    {
+      // reused stream: the frames exposed before now are dropped
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      m_start_time = now.tv_sec + now.tv_nsec * 1e-9;
+    }
+  else
+    {
+      m_start_time = -1.;
+      _streamOn();
+    }
+  m_acq_started = true;
+  m_cond.broadcast();
+}
+
+void VideoCtrlObj::stopAcq()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  m_acq_started = false;
+  write(m_pipes[1],"|",1);
+  aLock.unlock();
+}
+
+// lock-free: the acquisition thread holds the lock while a frame is
+// processed, the status must not wait for it
+void VideoCtrlObj::getStatus(HwInterface::StatusType& status)
+{
+  bool running = __atomic_load_n(&m_acq_thread_run,__ATOMIC_ACQUIRE);
+  // armed and waiting for the next trigger
+  if(running && _isTrigMult())
+    running = __atomic_load_n(&m_nb_triggers,__ATOMIC_ACQUIRE) > 0;
+  if(running)
+    status.set(HwInterface::StatusType::Exposure);
+  else if(__atomic_load_n(&m_acq_error,__ATOMIC_ACQUIRE))
+    status.set(HwInterface::StatusType::Fault);
+  else
+    status.set(HwInterface::StatusType::Ready);
+}
+
+int VideoCtrlObj::getNbHwAcquiredFrames()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_hdr_active)
+    return __atomic_load_n(&m_hdr_nb_images,__ATOMIC_ACQUIRE);
+  int nb_frames = __atomic_load_n(&m_acq_frame_id,__ATOMIC_ACQUIRE) + 1;
+  return nb_frames / _getNbFramesPerImage();
+}
+
+bool VideoCtrlObj::waitNbHwAcquiredFrames(int nb_frames,double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(nb_frames,timeout);
+
+  AutoMutex aLock(m_cond.mutex());
+  bool acquired;
+  while(!(acquired = getNbHwAcquiredFrames() >= nb_frames) &&
+	(m_acq_started || m_acq_thread_run) &&
+	_waitCond(timeout));
+
+  DEB_RETURN() << DEB_VAR1(acquired);
+  return acquired;
+}
+
+bool VideoCtrlObj::waitAcqEnd(double timeout)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(timeout);
+
+  AutoMutex aLock(m_cond.mutex());
+  bool ended;
+  while(!(ended = _isAcqEnded()) && _waitCond(timeout));
+
+  DEB_RETURN() << DEB_VAR1(ended);
+  return ended;
+}
+
+/** the thread is idle or, in IntTrigMult, the stream is armed with no
+ *  pending trigger: the same as the Ready status
+ */
+bool VideoCtrlObj::_isAcqEnded() const
+{
+  if(!m_acq_started && !m_acq_thread_run)
+    return true;
+  return _isTrigMult() && !__atomic_load_n(&m_nb_triggers,__ATOMIC_ACQUIRE);
+}
+
+/** wait for a broadcast, timeout is the total wait (counted from the first
+ *  call of a wait loop), negative for no timeout. False once expired.
+ */
+bool VideoCtrlObj::_waitCond(double& timeout)
+{
+  if(timeout < 0.)
+    return m_cond.wait(),true;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  double start = now.tv_sec + now.tv_nsec * 1e-9;
+  if(timeout == 0. || !m_cond.wait(timeout))
+    return false;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  timeout = std::max(timeout - (now.tv_sec + now.tv_nsec * 1e-9 - start),0.);
+  return true;
+}
+
+int VideoCtrlObj::_getNbFramesPerImage() const
+{
+  return m_hdr_active ? int(m_exp_bracket.size()) : m_acc_nb_frames;
+}
+// Acquisition thread
+//////////////////////
+
+VideoCtrlObj::_AcqThread::_AcqThread(VideoCtrlObj& aVideo) :
+  m_video(aVideo)
+{
+  pthread_attr_setscope(&m_thread_attr,PTHREAD_SCOPE_PROCESS);
+}
+
+
+void VideoCtrlObj::getSupportedVideoMode(std::list<VideoMode>& aList) const
+{
+  DEB_MEMBER_FUNCT();
+
+  for(std::set<VideoMode>::iterator i = m_available_format.begin();
+      i != m_available_format.end();++i)
+    aList.push_back(*i);
+}
+
+
+void VideoCtrlObj::setVideoMode(VideoMode mode)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(mode);
+
+  if(m_stream_compressed)
+    THROW_HW_ERROR(Error) << "Can't change the video mode during a compressed recording";
+
+  struct v4l2_format format;
+  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  int ret = v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format);
+  if(ret == -1)
+    THROW_HW_ERROR(Error) << "Can't get the format: " << strerror(errno);
+  unsigned int curr_format = format.fmt.pix.pixelformat;
+
+  int emulated = -1;
+  std::map<VideoMode,int>::const_iterator e = m_emulated_format.find(mode);
+  if(e != m_emulated_format.end())
+    {
+      emulated = e->second;
+      format.fmt.pix.pixelformat = EmulatedModes[emulated].v4l2_format;
+    }
+  else switch(mode)
+    {
+    case Y8:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;		break;
+    case Y16:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_Y16;		break;
+
+    case RGB555:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB555;	break;
+    case RGB565:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB565;	break;
+    case RGB24:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;	break;
+    case RGB32:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB32;	break;
+    case BGR24:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_BGR24;	break;
+    case BGR32:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_BGR32;	break;
+
+    case BAYER_BG8:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_SBGGR8;	break;
+    case BAYER_BG16:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_SBGGR16;	break;
+
+    case I420:		format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;	break;
+    case YUV411:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV411P;	break;
+    case YUV422:	format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV422P;	break;
+    default:
+      THROW_HW_ERROR(NotSupported) << "Not implemented yet!";
+    }
+
+  _setFormat(mode,emulated,format,format.fmt.pix.pixelformat != curr_format);
+}
+
+/** Set the device format delivering mode, converted by the EmulatedModes
+ *  entry emulated_index if >= 0, and the per mode state. The buffers are
+ *  only mapped again if the format changed; getModeSwitchTime measures
+ *  this part.
+ */
+void VideoCtrlObj::_setFormat(VideoMode mode,int emulated_index,
+			      struct v4l2_format& format,bool changed)
+{
+  DEB_MEMBER_FUNCT();
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC,&start);
+
+  // same format: the mapped buffers (and a kept stream) are reused
+  if(m_buffers.empty() || changed)
+    {
+      _unmap();
+      if(v4l2_ioctl(m_fd,VIDIOC_S_FMT,&format) == -1)
+	{
+	  int error = errno;
+	  _map();
+	  THROW_HW_ERROR(Error) << "Can't set the format: " << strerror(error);
+	}
+      _map();
+    }
+  const _EmulatedMode* emulated = NULL;
+  if(emulated_index >= 0)
+    {
+      emulated = &EmulatedModes[emulated_index];
+      m_emulated_format[mode] = emulated_index;
+    }
+  else
+    m_emulated_format.erase(mode);
+
+  m_bytes_per_line = format.fmt.pix.bytesperline;
+  switch(mode)
+    {
+    case Y8:
+      m_pixel_type = Kernels::Pixel8;
+      m_pixel_max = 0xff;
+      break;
+    case Y16:
+      m_pixel_type = Kernels::Pixel16;
+      m_pixel_max = emulated && emulated->kernel == Kernels::PACKED10_2_Y16 ? 0x3ff : 0xffff;
+      break;
+    default:
+      m_pixel_type = Kernels::NbPixelType;
+      m_pixel_max = 0;
+      m_hdr_active = false;
+      m_acc_nb_frames = 1;
+      m_corr_active = false;
+      m_ref_capture = NoReference;
+      m_ref_count = 0;
+      m_preview_active = false;
+      m_bin = Bin(1,1);
+      m_roi = Roi();
+      break;
+    }
+
+  if(emulated)
+    {
+      int width = format.fmt.pix.width,height = format.fmt.pix.height;
+      m_conv_src_stride = format.fmt.pix.bytesperline ? format.fmt.pix.bytesperline :
+	Kernels::getSrcLineSize(emulated->kernel,width);
+      m_conv_buffer.resize(width * height * Kernels::getDstPixelDepth(emulated->kernel));
+      m_conv_mode = mode;
+      m_conv_func = Kernels::getConvFunc(emulated->kernel);
+    }
+  else
+    m_conv_func = NULL;
+
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC,&end);
+  m_mode_switch_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+  DEB_TRACE() << "Video mode switch : " << m_mode_switch_time;
+}
+
+void VideoCtrlObj::getVideoMode(VideoMode& mode) const
+{
+  DEB_MEMBER_FUNCT();
+  
+  if(_isY32Output() || m_corr_active || m_conv_func)
+    {
+      mode = _isY32Output() ? Y32 : m_corr_active ? Y16 : m_conv_mode;
+      DEB_RETURN() << DEB_VAR1(mode);
+      return;
+    }
+
+  struct v4l2_format format;
+  _getFormat(format);
+  
+  _from_v4l2_format_2_lima(format.fmt.pix.pixelformat,mode);
+  DEB_RETURN() << DEB_VAR1(mode);
+}
+
+/** Choose among all the format/size/interval combinations the device
+ *  enumerates for mode the one delivering the most pixels per second,
+ *  with at least min_width x min_height pixels and min_fps frames per
+ *  second. The formats libv4l2 converts (V4L2_FMT_FLAG_EMULATED, e.g.
+ *  RGB24 decoded from MJPEG) are capped by the decode rate.
+ */
+void VideoCtrlObj::selectVideoMode(VideoMode mode,int min_width,int min_height,
+				   double min_fps)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR4(mode,min_width,min_height,min_fps);
+
+  {
+    AutoMutex aLock(m_cond.mutex());
+    if(m_acq_started)
+      THROW_HW_ERROR(Error) << "Can't change the video mode during acquisition";
+  }
+  if(m_stream_compressed)
+    THROW_HW_ERROR(Error) << "Can't change the video mode during a compressed recording";
+
+  // the sources of mode: its native format and the converted ones
+  std::vector<_ModeCandidate> sources;
+  struct v4l2_fmtdesc desc;
+  memset(&desc,0,sizeof(desc));
+  desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  for(desc.index = 0;v4l2_ioctl(m_fd,VIDIOC_ENUM_FMT,&desc) != -1;++desc.index)
+    {
+      _ModeCandidate source;
+      memset(&source,0,sizeof(source));
+      source.pixelformat = desc.pixelformat;
+      source.decoded = desc.flags & V4L2_FMT_FLAG_EMULATED;
+      VideoMode native_mode;
+      if(_from_v4l2_format_2_lima(desc.pixelformat,native_mode) && native_mode == mode)
+	{
+	  source.emulated = -1;
+	  sources.push_back(source);
+	}
+      for(unsigned i = 0;i < sizeof(EmulatedModes) / sizeof(_EmulatedMode);++i)
+	if(EmulatedModes[i].mode == mode &&
+	   (unsigned int)EmulatedModes[i].v4l2_format == desc.pixelformat)
+	  {
+	    source.emulated = i;
+	    sources.push_back(source);
+	  }
+    }
+  if(sources.empty())
+    THROW_HW_ERROR(NotSupported) << "The camera can't deliver " << DEB_VAR1(mode);
+
+  struct v4l2_format curr;
+  curr.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_G_FMT,&curr) == -1)
+    THROW_HW_ERROR(Error) << "Can't get the format: " << strerror(errno);
+
+  std::vector<_ModeCandidate> candidates;
+  for(unsigned s = 0;s < sources.size();++s)
+    {
+      std::vector<std::pair<int,int> > sizes;
+      struct v4l2_frmsizeenum frmsize;
+      memset(&frmsize,0,sizeof(frmsize));
+      frmsize.pixel_format = sources[s].pixelformat;
+      for(frmsize.index = 0;v4l2_ioctl(m_fd,VIDIOC_ENUM_FRAMESIZES,&frmsize) != -1;
+	  ++frmsize.index)
+	{
+	  if(frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE)
+	    sizes.push_back(std::make_pair(frmsize.discrete.width,frmsize.discrete.height));
+	  else
+	    {
+	      // the largest size gives the most pixels per frame
+	      sizes.push_back(std::make_pair(frmsize.stepwise.max_width,
+					     frmsize.stepwise.max_height));
+	      break;
+	    }
+	}
+      if(sizes.empty())
+	sizes.push_back(std::make_pair(curr.fmt.pix.width,curr.fmt.pix.height));
+
+      for(unsigned z = 0;z < sizes.size();++z)
+	{
+	  _ModeCandidate candidate = sources[s];
+	  candidate.width = sizes[z].first;
+	  candidate.height = sizes[z].second;
+
+	  struct v4l2_frmivalenum frmival;
+	  memset(&frmival,0,sizeof(frmival));
+	  frmival.pixel_format = candidate.pixelformat;
+	  frmival.width = candidate.width;
+	  frmival.height = candidate.height;
+	  for(frmival.index = 0;v4l2_ioctl(m_fd,VIDIOC_ENUM_FRAMEINTERVALS,&frmival) != -1;
+	      ++frmival.index)
+	    {
+	      // the shortest interval gives the highest rate
+	      const struct v4l2_fract& interval =
+		frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE ? frmival.discrete : frmival.stepwise.min;
+	      if(_fps(interval) > candidate.fps)
+		{
+		  candidate.interval = interval;
+		  candidate.fps = _fps(interval);
+		}
+	      if(frmival.type != V4L2_FRMIVAL_TYPE_DISCRETE)
+		break;
+	    }
+
+	  double pixels = double(candidate.width) * candidate.height;
+	  candidate.delivered_fps = candidate.fps;
+	  if(candidate.decoded && m_decode_rate > 0. &&
+	     candidate.fps * pixels > m_decode_rate)
+	    candidate.delivered_fps = m_decode_rate / pixels;
+	  DEB_TRACE() << "Candidate " << _fourcc(candidate.pixelformat)
+		      << (candidate.emulated >= 0 ? " converted" : "")
+		      << (candidate.decoded ? " decoded" : "") << " "
+		      << candidate.width << "x" << candidate.height << " at "
+		      << candidate.fps << " fps, delivers " << candidate.delivered_fps;
+	  candidates.push_back(candidate);
+	}
+    }
+
+  // the best rate of all, or only the best frame rate if min_fps can't be met
+  const _ModeCandidate* best = NULL;
+  for(int pass = 0;!best && pass < 2;++pass)
+    for(unsigned c = 0;c < candidates.size();++c)
+      {
+	const _ModeCandidate& candidate = candidates[c];
+	if(candidate.width < min_width || candidate.height < min_height ||
+	   (!pass && candidate.delivered_fps < min_fps))
+	  continue;
+	if(!best)
+	  {
+	    best = &candidate;
+	    continue;
+	  }
+	double pixels = double(candidate.width) * candidate.height;
+	double best_pixels = double(best->width) * best->height;
+	double rate = pass ? candidate.delivered_fps : pixels * candidate.delivered_fps;
+	double best_rate = pass ? best->delivered_fps : best_pixels * best->delivered_fps;
+	if(rate > best_rate ||
+	   (rate == best_rate && (pixels > best_pixels ||
+				  (pixels == best_pixels && best->decoded && !candidate.decoded))))
+	  best = &candidate;
+      }
+  if(!best)
+    THROW_HW_ERROR(InvalidValue) << "The camera has no " << DEB_VAR1(mode) << " of "
+				 << min_width << "x" << min_height;
+  if(best->delivered_fps < min_fps)
+    DEB_WARNING() << "Only " << best->delivered_fps << " fps can be delivered";
+
+  DEB_ALWAYS() << "Select " << _fourcc(best->pixelformat) << " "
+	       << best->width << "x" << best->height << " at " << best->fps << " fps";
+
+  struct v4l2_format format = curr;
+  format.fmt.pix.pixelformat = best->pixelformat;
+  format.fmt.pix.width = best->width;
+  format.fmt.pix.height = best->height;
+  format.fmt.pix.bytesperline = 0;
+  format.fmt.pix.sizeimage = 0;
+  _setFormat(mode,best->emulated,format,
+	     format.fmt.pix.pixelformat != curr.fmt.pix.pixelformat ||
+	     format.fmt.pix.width != curr.fmt.pix.width ||
+	     format.fmt.pix.height != curr.fmt.pix.height);
+
+  if(best->fps > 0. && m_capabilities.getData().time_per_frame)
+    {
+      struct v4l2_streamparm streamparm;
+      memset(&streamparm,0,sizeof(streamparm));
+      streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      streamparm.parm.capture.timeperframe = best->interval;
+      if(v4l2_ioctl(m_fd,VIDIOC_S_PARM,&streamparm) == -1)
+	DEB_WARNING() << "Can't set the frame interval: " << strerror(errno);
+    }
+}
+
+void VideoCtrlObj::getFrameRate(double& fps)
+{
+  DEB_MEMBER_FUNCT();
+
+  struct v4l2_streamparm streamparm;
+  memset(&streamparm,0,sizeof(streamparm));
+  streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_G_PARM,&streamparm) == -1)
+    THROW_HW_ERROR(Error) << "Error querying stream param : " << strerror(errno);
+  fps = _fps(streamparm.parm.capture.timeperframe);
+  DEB_RETURN() << DEB_VAR1(fps);
+}
+
+void VideoCtrlObj::setDecodeRate(double pixels_per_second)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(pixels_per_second);
+  m_decode_rate = pixels_per_second;
+}
+
+void VideoCtrlObj::getDecodeRate(double& pixels_per_second) const
+{
+  pixels_per_second = m_decode_rate;
+}
+
+void VideoCtrlObj::setLive(bool start_flag)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(start_flag);
+
+  m_live = start_flag;
+  if(start_flag)			// start
+    {
+
+      setNbHwFrames(0);
+      
+      // prepare to request buffers
+      prepareAcq();
+      startAcq();
+    }
+  else
+    {
+      AutoMutex aLock(m_cond.mutex());
+      m_acq_started = false;
+      write(m_pipes[1],"|",1);
+      aLock.unlock();
+    }
+}
+
+void VideoCtrlObj::getLive(bool &flag) const
+{
+  DEB_MEMBER_FUNCT();
+  flag = m_live;
+}
+
+void VideoCtrlObj::getGain(double &gain) const
+{
+  gain = m_gain;
+}
+
+void VideoCtrlObj::setGain(double gain)
+{
+  m_gain = gain;
+}
+
+// Binning and roi are done by the plugin kernels for monochrome modes,
+// before the image is handed to Lima.
+void VideoCtrlObj::checkBin(Bin& bin)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bin);
+
+  if(m_pixel_type == Kernels::NbPixelType)
+    bin = Bin(1,1);
+  else
+    {
+      int bin_x = std::max(1,std::min(bin.getX(),16));
+      int bin_y = std::max(1,std::min(bin.getY(),16));
+      bin = Bin(bin_x,bin_y);
+    }
+
+  DEB_RETURN() << DEB_VAR1(bin);
+}
+
+void VideoCtrlObj::checkRoi(const Roi& set_roi, Roi& hw_roi)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(set_roi);
+
+  Size size;
+  getMaxImageSize(size);
+  Roi full_roi(0,0,size.getWidth() / m_bin.getX(),size.getHeight() / m_bin.getY());
+  if(m_pixel_type == Kernels::NbPixelType || set_roi.isEmpty())
+    hw_roi = full_roi;
+  else
+    {
+      Point tl = set_roi.getTopLeft();
+      Size roi_size = set_roi.getSize();
+      int x = std::max(0,std::min(tl.getX(),full_roi.getSize().getWidth() - 1));
+      int y = std::max(0,std::min(tl.getY(),full_roi.getSize().getHeight() - 1));
+      int width = std::min(roi_size.getWidth(),full_roi.getSize().getWidth() - x);
+      int height = std::min(roi_size.getHeight(),full_roi.getSize().getHeight() - y);
+      hw_roi = Roi(x,y,width,height);
+    }
+
+  DEB_RETURN() << DEB_VAR1(hw_roi);
+}
+
+void VideoCtrlObj::setBin(const Bin& bin)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(bin);
+
+  Bin hw_bin = bin;
+  checkBin(hw_bin);
+  m_bin = hw_bin;
+}
+
+void VideoCtrlObj::setRoi(const Roi& roi)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(roi);
+
+  Size size;
+  getMaxImageSize(size);
+  Roi hw_roi;
+  checkRoi(roi,hw_roi);
+  // the full frame is not considered as a roi
+  if(hw_roi.getTopLeft().getX() == 0 && hw_roi.getTopLeft().getY() == 0 &&
+     hw_roi.getSize().getWidth() == size.getWidth() / m_bin.getX() &&
+     hw_roi.getSize().getHeight() == size.getHeight() / m_bin.getY())
+    m_roi = Roi();
+  else
+    m_roi = hw_roi;
+}
+
+bool VideoCtrlObj::checkAutoGainMode(AutoGainMode mode) const
+{
+  return true;
+}
+
+void VideoCtrlObj::setHwAutoGainMode(AutoGainMode mode)
+{
+}
+
+bool VideoCtrlObj::isAutoExposureSupported()
+{
+  DEB_MEMBER_FUNCT();
+  return m_autoexp_supported;
+}
+
+void VideoCtrlObj::setAutoExposure(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  if(!m_autoexp_supported)
+    {
+      if(active)
+	THROW_HW_ERROR(NotSupported) << "Auto Exposure not supported";
+      return;
+    }
+
+  // back to manual, the last requested exposure is restored in the same
+  // atomic write
+  Controls::ValueMap values;
+  values[V4L2_CID_EXPOSURE_AUTO] = active ? m_autoexp_value : V4L2_EXPOSURE_MANUAL;
+  if(!active && m_exptime_supported && m_exp_time > 0)
+    values[V4L2_CID_EXPOSURE_ABSOLUTE] = _exp_time_2_v4l2(m_exp_time);
+  m_controls.setValues(values);
+}
+
+void VideoCtrlObj::setStatisticsActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  AutoMutex aLock(m_cond.mutex());
+  m_stat_active = active;
+}
+
+void VideoCtrlObj::getStatisticsActive(bool& active) const
+{
+  active = m_stat_active;
+}
+
+void VideoCtrlObj::getLastImageStatistics(double& min,double& max,double& mean)
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  if(!m_stat_active || m_pixel_type == Kernels::NbPixelType)
+    THROW_HW_ERROR(Error) << "Statistics are not active for this video mode";
+
+  min = m_last_stat.min,max = m_last_stat.max,mean = m_last_stat.mean;
+  DEB_RETURN() << DEB_VAR3(min,max,mean);
+}
+
+void VideoCtrlObj::setExposureBracket(const std::vector<double>& exp_times)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(exp_times.size());
+
+  if(!exp_times.empty() && !m_exptime_supported)
+    THROW_HW_ERROR(NotSupported) << "Exposure control not supported";
+  for(std::vector<double>::const_iterator i = exp_times.begin();
+      i != exp_times.end();++i)
+    if(*i <= 0.)
+      THROW_HW_ERROR(InvalidValue) << "Invalid exposure time: " << *i;
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the exposure bracket during acquisition";
+  m_exp_bracket = exp_times;
+}
+
+void VideoCtrlObj::getExposureBracket(std::vector<double>& exp_times) const
+{
+  exp_times = m_exp_bracket;
+}
+
+void VideoCtrlObj::setExposureLatency(int nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(nb_frames);
+
+  if(nb_frames < 1)
+    THROW_HW_ERROR(InvalidValue) << "Exposure latency must be at least 1 frame";
+
+  AutoMutex aLock(m_cond.mutex());
+  m_exp_latency = nb_frames;
+}
+
+void VideoCtrlObj::getExposureLatency(int& nb_frames) const
+{
+  nb_frames = m_exp_latency;
+}
+
+void VideoCtrlObj::getFrameExpTime(int frame_id,double& exp_time)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(frame_id);
+
+  AutoMutex aLock(m_cond.mutex());
+  const _ExpTag& tag = m_exp_tags[std::max(frame_id,0) % m_exp_tags.size()];
+  if(frame_id < 0 || tag.frame_id != frame_id)
+    THROW_HW_ERROR(InvalidValue) << "Exposure time of frame " << frame_id
+				 << " is not known";
+  exp_time = tag.exp_time;
+
+  DEB_RETURN() << DEB_VAR1(exp_time);
+}
+
+void VideoCtrlObj::setHdrActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  if(active && m_pixel_type == Kernels::NbPixelType)
+    THROW_HW_ERROR(NotSupported) << "HDR merge is only available in Y8 and Y16 video modes";
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_acq_started)
+    THROW_HW_ERROR(Error) << "Can't change the HDR merge during acquisition";
+  m_hdr_active = active;
+}
+
+void VideoCtrlObj::getHdrActive(bool& active) const
+{
+  active = m_hdr_active;
+}
+
+void VideoCtrlObj::setHdrSaturation(int level)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(level);
+
+  if(level < 0)
+    THROW_HW_ERROR(InvalidValue) << "Invalid saturation level: " << level;
+  m_hdr_saturation = level;
+}
+
+void VideoCtrlObj::getHdrSaturation(int& level) const
+{
+  level = m_hdr_saturation;
+}
+
+/** Reset the exposure tags and, when bracketing, switch to the manual
+ *  exposure with the first exposure of the bracket.
+ */
+void VideoCtrlObj::_prepareExposure()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  _ExpTag no_tag = {-1,-1.,false};
+  m_exp_tags.assign(m_exp_tags.size(),no_tag);
+  m_exp_pending.clear();
+  m_frame_exp_time = -1.;
+  if(!m_exptime_supported)
+    return;
+
+  if(m_exp_bracket.empty())
+    {
+      m_frame_exp_time = _v4l2_2_exp_time(m_controls.getValue(V4L2_CID_EXPOSURE_ABSOLUTE));
+      return;
+    }
+
+  Controls::ValueMap values;
+  if(m_autoexp_supported)
+    values[V4L2_CID_EXPOSURE_AUTO] = V4L2_EXPOSURE_MANUAL;
+  values[V4L2_CID_EXPOSURE_ABSOLUTE] = _exp_time_2_v4l2(m_exp_bracket[0]);
+  m_controls.setValues(values);
+  m_frame_exp_time = _v4l2_2_exp_time(values[V4L2_CID_EXPOSURE_ABSOLUTE]);
+}
+
+/** Called by the acquisition thread for each frame: tag it with the
+ *  exposure in effect and write the bracket exposure of the frame
+ *  m_exp_latency frames ahead. The bracket is indexed and the writes are
+ *  tracked with the driver frame sequence, so frames dropped by the
+ *  driver or by the plugin don't shift the exposures nor the tags.
+ */
+void VideoCtrlObj::_updateExposure(int frame_id)
+{
+  DEB_MEMBER_FUNCT();
+
+  int sequence = m_buffer.sequence;
+  if(!frame_id)
+    m_exp_sequence_origin = sequence;
+  while(!m_exp_pending.empty() && m_exp_pending.front().first <= sequence)
+    {
+      m_frame_exp_time = m_exp_pending.front().second;
+      m_exp_pending.pop_front();
+    }
+  _ExpTag& tag = m_exp_tags[frame_id % m_exp_tags.size()];
+  tag.frame_id = frame_id,tag.exp_time = m_frame_exp_time,tag.corrupt = false;
+
+  if(m_exp_bracket.empty())
+    return;
+
+  int index = (sequence + m_exp_latency - m_exp_sequence_origin) % int(m_exp_bracket.size());
+  double exp_time = m_exp_bracket[index];
+  double last_exp_time = m_exp_pending.empty() ? m_frame_exp_time :
+    m_exp_pending.back().second;
+  if(_exp_time_2_v4l2(exp_time) == _exp_time_2_v4l2(last_exp_time))
+    return;
+
+  Controls::ValueMap values;
+  values[V4L2_CID_EXPOSURE_ABSOLUTE] = _exp_time_2_v4l2(exp_time);
+  try
+    {
+      m_controls.setValues(values);
+      m_exp_pending.push_back(std::make_pair(sequence + m_exp_latency,
+					     _v4l2_2_exp_time(values[V4L2_CID_EXPOSURE_ABSOLUTE])));
+    }
+  catch(Exception&)
+    {
+      DEB_ERROR() << "Can't apply the bracket exposure of frame "
+		  << frame_id + m_exp_latency;
+    }
+}
+
+/** Called by _restartStream and _reopen before the stream starts again:
+ *  the driver sequence restarts from 0, so the pending writes keyed on the
+ *  old sequence would never be applied to the tags. The last written
+ *  exposure is the one in effect, the bracket exposure of the next frame
+ *  is written again; the stream being off, its first frame is taken with it.
+ */
+void VideoCtrlObj::_restartExposure()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_exp_pending.empty())
+    m_frame_exp_time = m_exp_pending.back().second;
+  m_exp_pending.clear();
+  if(m_exp_bracket.empty() || !m_exptime_supported)
+    return;
+
+  int frame_id = __atomic_load_n(&m_acq_frame_id,__ATOMIC_ACQUIRE) + 1;
+  // the new sequence 0 takes the bracket exposure of the next frame
+  m_exp_sequence_origin = -frame_id;
+  Controls::ValueMap values;
+  values[V4L2_CID_EXPOSURE_ABSOLUTE] =
+    _exp_time_2_v4l2(m_exp_bracket[frame_id % m_exp_bracket.size()]);
+  try
+    {
+      m_controls.setValues(values);
+      m_exp_pending.push_back(std::make_pair(0,_v4l2_2_exp_time(values[V4L2_CID_EXPOSURE_ABSOLUTE])));
+    }
+  catch(Exception&)
+    {
+      DEB_ERROR() << "Can't apply the bracket exposure of frame " << frame_id;
+    }
+}
+
+/** Called by the acquisition thread for each dequeued buffer, return false
+ *  if the frame must be requeued without being delivered. In IntTrigMult
+ *  only a frame whose exposure started after the pending trigger is
+ *  delivered: with monotonic timestamps the frame start is the timestamp
+ *  (start of exposure) or the timestamp minus one frame period (end of
+ *  frame), otherwise the frame in progress at the trigger is skipped.
+ */
+bool VideoCtrlObj::_acceptFrame()
+{
+  DEB_MEMBER_FUNCT();
+
+  double timestamp = m_buffer.timestamp.tv_sec + m_buffer.timestamp.tv_usec * 1e-6;
+  double frame_start = timestamp;
+  if(m_last_timestamp > 0. &&
+     (m_buffer.flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) != V4L2_BUF_FLAG_TSTAMP_SRC_SOE)
+    frame_start -= timestamp - m_last_timestamp;
+  m_last_timestamp = timestamp;
+
+  bool monotonic = (m_buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+    V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+  if(!_isTrigMult())
+    // a kept stream was already running: only the frames exposed
+    // after startAcq
+    return !(monotonic && m_start_time > 0. && frame_start < m_start_time);
+  if(!__atomic_load_n(&m_nb_triggers,__ATOMIC_ACQUIRE))
+    return false;
+
+  if(monotonic ? frame_start < m_trig_time : m_trig_skip-- > 0)
+    return false;
+
+  // the last pending trigger is served, for waitAcqEnd
+  if(!__atomic_sub_fetch(&m_nb_triggers,1,__ATOMIC_RELEASE))
+    m_cond.broadcast();
+  if(monotonic)
+    DEB_TRACE() << "Trigger to frame latency : " << timestamp - m_trig_time;
+  return true;
+}
+
+/** Live mode: while newer frames are already waiting in the driver,
+ *  requeue the dequeued buffer and take the newer one. Nothing is copied.
+ */
+void VideoCtrlObj::_dequeueLatest()
+{
+  DEB_MEMBER_FUNCT();
+
+  struct pollfd fd;
+  fd.fd = m_fd;
+  fd.events = POLLIN;
+  while(poll(&fd,1,0) > 0 && (fd.revents & POLLIN))
+    {
+      struct v4l2_buffer newer = m_buffer;
+      if(v4l2_ioctl(m_fd,VIDIOC_DQBUF,&newer) == -1)
+	break;
+      m_buffer_queued[newer.index] = false;
+      _queueBuffer(m_buffer);
+      m_buffer = newer;
+      ++m_nb_skipped_frames;
+    }
+  // the skipped frames are not driver drops
+  m_last_sequence = m_buffer.sequence;
+}
+
+/** Called by the acquisition thread for each accepted frame, before it
+ *  is touched by anything else. Only cheap checks: the driver error
+ *  flag, a payload shorter than the frame and, for JPEG streams, the
+ *  SOI and EOI markers (a few bytes at both ends of the buffer).
+ */
+bool VideoCtrlObj::_checkFrame()
+{
+  DEB_MEMBER_FUNCT();
+
+  const struct v4l2_pix_format& pix = m_acq_format.fmt.pix;
+  unsigned int size = m_buffer.bytesused;
+  const char* error = NULL;
+  if(m_buffer.flags & V4L2_BUF_FLAG_ERROR)
+    {
+      // corrupted by the transfer (e.g. USB packet loss)
+      error = "driver error";
+      ++m_nb_frame_errors;
+    }
+  else if(pix.pixelformat == V4L2_PIX_FMT_MJPEG || pix.pixelformat == V4L2_PIX_FMT_JPEG)
+    {
+      if(!_is_jpeg_complete(m_buffers[m_buffer.index],size))
+	error = "broken JPEG";
+    }
+  else
+    {
+      // some drivers leave bytesused to 0
+      unsigned int frame_size = pix.bytesperline ?
+	std::min(pix.sizeimage,pix.bytesperline * pix.height) : pix.sizeimage;
+      if(size && size < frame_size)
+	error = "truncated";
+    }
+  if(!error)
+    return true;
+
+  ++m_nb_corrupt_frames;
+  DEB_TRACE() << "Corrupt frame " << m_buffer.sequence << " (" << error << "), "
+	      << DEB_VAR1(size);
+  return false;
+}
+
+/** RepeatLastFrame: deliver the last good image again in place of the
+ *  corrupt frame, which is marked. Dropped if there is no good image
+ *  yet or if the images are merged from several frames.
+ */
+bool VideoCtrlObj::_repeatLastFrame()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_last_good.empty() || _getNbFramesPerImage() > 1)
+    return true;
+
+  int frame_id = __atomic_add_fetch(&m_acq_frame_id,1,__ATOMIC_RELEASE);
+  _updateExposure(frame_id);
+  m_exp_tags[frame_id % m_exp_tags.size()].corrupt = true;
+  bool continueAcq = callNewImage((char*)&m_last_good[0],m_last_good_width,
+				  m_last_good_height,m_last_good_mode);
+  m_cond.broadcast();
+  return continueAcq;
+}
+
+/** Called by the acquisition thread at each dequeue: the driver captures
+ *  only into its queued buffers, when none is left the frames are
+ *  dropped until one is requeued (seen as a gap of the frame sequence).
+ *  The last buffers of an acquisition are not requeued on purpose.
+ */
+void VideoCtrlObj::_checkStarvation()
+{
+  DEB_MEMBER_FUNCT();
+
+  long long sequence = m_buffer.sequence;
+  if(m_last_sequence >= 0 && sequence > m_last_sequence + 1)
+    m_nb_dropped_frames += sequence - m_last_sequence - 1;
+  m_last_sequence = sequence;
+
+  if(m_nb_capture_frames && !_isTrigMult() &&
+     m_acq_frame_id >= int(m_nb_capture_frames - m_buffers.size()))
+    return;
+  int nb_queued = std::count(m_buffer_queued.begin(),m_buffer_queued.end(),true);
+  if(m_min_queued < 0 || nb_queued < m_min_queued)
+    m_min_queued = nb_queued;
+  if(nb_queued)
+    return;
+
+  ++m_nb_starvations;
+  DEB_TRACE() << "No buffer left in the driver at frame " << sequence;
+  if(m_buffer_growth)
+    _growBuffers();
+}
+
+/** Add as many buffers as the ring already has (within the memory
+ *  limit) with VIDIOC_CREATE_BUFS, while streaming. They are mapped and
+ *  queued at once and kept until the format changes.
+ */
+void VideoCtrlObj::_growBuffers()
+{
+  DEB_MEMBER_FUNCT();
+
+  long long max_nb_buffers = (long long)m_max_buffer_memory * (1 << 20) / m_buffer.length;
+  int nb_buffers = std::min<long long>(m_buffers.size(),max_nb_buffers - m_buffers.size());
+  if(nb_buffers <= 0)
+    {
+      DEB_WARNING() << "Buffer memory limit reached with " << m_buffers.size() << " buffers";
+      m_buffer_growth = false;
+      return;
+    }
+
+  struct v4l2_create_buffers create;
+  memset(&create,0,sizeof(create));
+  create.count = nb_buffers;
+  create.memory = V4L2_MEMORY_MMAP;
+  create.format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_G_FMT,&create.format) == -1 ||
+     v4l2_ioctl(m_fd,VIDIOC_CREATE_BUFS,&create) == -1)
+    {
+      DEB_WARNING() << "Can't create buffers: " << strerror(errno);
+      m_buffer_growth = false;
+      return;
+    }
+  if(create.index != m_buffers.size())
+    {
+      // not contiguous with the mapped ones, left to the next REQBUFS
+      DEB_WARNING() << "Unexpected buffer index " << create.index;
+      m_buffer_growth = false;
+      return;
+    }
+
+  for(unsigned i = 0;i < create.count;++i)
+    {
+      struct v4l2_buffer buffer;
+      memset(&buffer,0,sizeof(buffer));
+      buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+      buffer.memory = V4L2_MEMORY_MMAP;
+      buffer.index = create.index + i;
+      if(v4l2_ioctl(m_fd,VIDIOC_QUERYBUF,&buffer) == -1 ||
+	 buffer.length != m_buffer.length)
+	{
+	  DEB_WARNING() << "Can't query buffer " << buffer.index << ": " << strerror(errno);
+	  m_buffer_growth = false;
+	  break;
+	}
+      int map_flags = MAP_SHARED | (m_buffer_prefault ? MAP_POPULATE : 0);
+      void* p = v4l2_mmap(NULL,buffer.length,PROT_READ | PROT_WRITE,
+			  map_flags,m_fd,buffer.m.offset);
+      if(p == MAP_FAILED)
+	{
+	  DEB_WARNING() << "Can't map buffer " << buffer.index << ": " << strerror(errno);
+	  m_buffer_growth = false;
+	  break;
+	}
+      if(m_buffer_prefault)
+	_prefault(p,buffer.length);
+      m_buffers.push_back((unsigned char*)p);
+      m_buffer_queued.push_back(false);
+      _queueBuffer(buffer);
+    }
+  DEB_TRACE() << "Buffer ring grown to " << m_buffers.size();
+}
+
+/** Called by the acquisition thread (locked) when no frame comes in time
+ *  or a dequeue fails. The stream is restarted, a device gone (ENODEV)
+ *  or a stream failing again and again is reopened. false when the
+ *  acquisition can't go on.
+ */
+bool VideoCtrlObj::_recover(int error)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(error,m_nb_failures);
+
+  bool recovered = false;
+  if(error != ENODEV && ++m_nb_failures <= 3)
+    recovered = _restartStream();
+  if(!recovered && m_reconnect_timeout > 0.)
+    recovered = _reopen();
+  if(!recovered)
+    {
+      DEB_ERROR() << "Acquisition stopped: " << strerror(error);
+      __atomic_store_n(&m_acq_error,true,__ATOMIC_RELEASE);
+    }
+  return recovered && m_acq_started && !m_quit;
+}
+
+/// all buffers back to the driver, the frames in flight are lost
+bool VideoCtrlObj::_restartStream()
+{
+  DEB_MEMBER_FUNCT();
+
+  _streamOff();
+  try
+    {
+      for(unsigned i = 0;i < m_buffers.size();++i)
+	{
+	  struct v4l2_buffer buffer = m_buffer;
+	  buffer.index = i;
+	  if(!_queueBuffer(buffer))
+	    return false;
+	}
+      _restartExposure();
+      _streamOn();
+    }
+  catch(Exception&)
+    {
+      return false;
+    }
+  ++m_nb_stream_restarts;
+  m_last_timestamp = -1.;
+  m_last_sequence = -1;
+  DEB_WARNING() << "Stream restarted";
+  return true;
+}
+
+/** Wait for the device to be back (a replugged USB camera may get
+ *  another node, it is found by its bus info), open it and set the
+ *  format, frame interval, controls and buffers back.
+ *
+ *  The new descriptor replaces m_fd here and in the controls, under their
+ *  locks. The old one is not closed yet: another thread may have read
+ *  its number just before, it must keep failing on the dead device
+ *  instead of reaching a file opened meanwhile on the same number. It is
+ *  closed by the next prepareAcq.
+ */
+bool VideoCtrlObj::_reopen()
+{
+  DEB_MEMBER_FUNCT();
+
+  // the buffers of the old device, its ioctls may all fail now
+  _streamOff();
+  for(unsigned i = 0;i < m_buffers.size();++i)
+    v4l2_munmap(m_buffers[i],m_buffer.length);
+  m_buffers.clear();
+  m_buffer_queued.clear();
+  if(m_decoder)
+    {
+      v4lconvert_destroy(m_decoder);
+      m_decoder = NULL;
+    }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  double deadline = now.tv_sec + now.tv_nsec * 1e-9 + m_reconnect_timeout;
+  int fd = -1;
+  while(fd < 0 && m_acq_started && !m_quit)
+    {
+      std::string path = m_dev_path;
+      try
+	{
+	  if(!m_bus_info.empty())
+	    path = Discovery::findDevice(m_bus_info);
+	}
+      catch(Exception&)
+	{
+	}
+      fd = v4l2_open(path.c_str(),O_RDWR);
+      struct v4l2_capability cap;
+      if(fd >= 0 && (v4l2_ioctl(fd,VIDIOC_QUERYCAP,&cap) == -1 ||
+		     m_bus_info != (char*)cap.bus_info))
+	{
+	  v4l2_close(fd);
+	  fd = -1;
+	}
+      if(fd >= 0)
+	break;
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      if(now.tv_sec + now.tv_nsec * 1e-9 >= deadline)
+	return false;
+      // stopAcq and the getters are not blocked meanwhile
+      m_cond.wait(.2);
+    }
+  if(fd < 0)
+    return false;
+
+  // the acquisition thread holds m_cond
+  m_retired_fds.push_back(m_fd);
+  m_fd = fd;
+  m_controls.setFd(fd);
+
+  try
+    {
+      struct v4l2_format format = m_acq_format;
+      if(v4l2_ioctl(m_fd,VIDIOC_S_FMT,&format) == -1)
+	THROW_HW_ERROR(Error) << "Can't set the format: " << strerror(errno);
+      struct v4l2_streamparm streamparm = m_acq_parm;
+      if(m_acq_parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME &&
+	 v4l2_ioctl(m_fd,VIDIOC_S_PARM,&streamparm) == -1)
+	DEB_WARNING() << "Can't set the frame interval: " << strerror(errno);
+      m_controls.restore();
+      if(m_metadata.isOpen())
+	_reopenMetadata();
+      if(m_stream_compressed && !(m_decoder = v4lconvert_create(m_fd)))
+	THROW_HW_ERROR(Error) << "Can't create the frame decoder";
+      _map();
+      for(unsigned i = 0;i < m_buffers.size();++i)
+	{
+	  m_buffer.index = i;
+	  if(!_queueBuffer(m_buffer))
+	    THROW_HW_ERROR(Error) << "Error queue buff " << strerror(errno);
+	}
+      _restartExposure();
+      _streamOn();
+    }
+  catch(Exception&)
+    {
+      return false;
+    }
+  ++m_nb_reconnects;
+  m_nb_failures = 0;
+  m_last_timestamp = -1.;
+  m_last_sequence = -1;
+  DEB_WARNING() << "Device reopened";
+  return true;
+}
+
+/// descriptors of the devices replaced by _reopen
+void VideoCtrlObj::_closeRetiredFds()
+{
+  for(size_t i = 0;i < m_retired_fds.size();++i)
+    v4l2_close(m_retired_fds[i]);
+  m_retired_fds.clear();
+}
+
+void VideoCtrlObj::setKeepStreaming(bool keep)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(keep);
+
+  AutoMutex aLock(m_cond.mutex());
+  m_keep_streaming = keep;
+  if(!keep && !m_acq_thread_run)
+    _streamOff();
+}
+
+void VideoCtrlObj::getKeepStreaming(bool& keep) const
+{
+  keep = m_keep_streaming;
+}
+
+void VideoCtrlObj::setBufferPrefault(bool prefault)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(prefault);
+
+  m_buffer_prefault = prefault;
+  if(prefault)
+    for(unsigned i = 0;i < m_buffers.size();++i)
+      _prefault(m_buffers[i],m_buffer.length);
+}
+
+void VideoCtrlObj::getBufferPrefault(bool& prefault) const
+{
+  prefault = m_buffer_prefault;
+}
+
+void VideoCtrlObj::getModeSwitchTime(double& time) const
+{
+  DEB_MEMBER_FUNCT();
+  time = m_mode_switch_time;
+  DEB_RETURN() << DEB_VAR1(time);
+}
+
+void VideoCtrlObj::getFirstFrameDelay(double& delay)
+{
+  DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  delay = m_first_frame_delay;
+  DEB_RETURN() << DEB_VAR1(delay);
+}
+
+/// VIDIOC_QBUF, keeps the buffer state
+bool VideoCtrlObj::_queueBuffer(struct v4l2_buffer& buffer)
+{
+  DEB_MEMBER_FUNCT();
+
+  if(v4l2_ioctl(m_fd,VIDIOC_QBUF,&buffer) == -1)
+    {
+      DEB_ERROR() << "Error queue buff " << buffer.index << ": " << strerror(errno);
+      return false;
+    }
+  m_buffer_queued[buffer.index] = true;
+  return true;
+}
+
+void VideoCtrlObj::_streamOn()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_streaming)
+    return;
+  // first, so the first frames have their metadata
+  m_metadata.start();
+  enum v4l2_buf_type buff_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_STREAMON,&buff_type) == -1)
+    {
+      m_metadata.stop();
+      THROW_HW_ERROR(Error) << "Error starting stream : " << strerror(errno);
+    }
+  m_streaming = true;
+}
+
+/// the driver gives back all the buffers
+void VideoCtrlObj::_streamOff()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_streaming)
+    return;
+  enum v4l2_buf_type buff_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_STREAMOFF,&buff_type) == -1)
+    DEB_ERROR() << "Error stopping stream : " << strerror(errno);
+  m_metadata.stop();
+  m_streaming = false;
+  m_buffer_queued.assign(m_buffers.size(),false);
+}
+
+/// dequeue the frames captured by a kept stream since the last acquisition
+void VideoCtrlObj::_flushStream()
+{
+  DEB_MEMBER_FUNCT();
+
+  struct pollfd fd;
+  fd.fd = m_fd;
+  fd.events = POLLIN;
+  int nb_frames = 0;
+  struct v4l2_buffer buffer = m_buffer;
+  while(poll(&fd,1,0) > 0 && (fd.revents & POLLIN) &&
+	v4l2_ioctl(m_fd,VIDIOC_DQBUF,&buffer) != -1)
+    {
+      m_buffer_queued[buffer.index] = false;
+      ++nb_frames;
+    }
+  DEB_TRACE() << DEB_VAR1(nb_frames);
+}
+
+void VideoCtrlObj::_updateFirstFrameDelay()
+{
+  DEB_MEMBER_FUNCT();
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  m_first_frame_delay = now.tv_sec + now.tv_nsec * 1e-9 - m_prepare_time;
+  DEB_TRACE() << "Prepare to first frame : " << m_first_frame_delay;
+}
+
+void VideoCtrlObj::startRecording(const std::string& path)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(path);
+
+  struct v4l2_format format;
+  memset(&format,0,sizeof(format));
+  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format) == -1)
+    THROW_HW_ERROR(Error) << "Can't get format: " << strerror(errno);
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_recorder.isOpen())
+    THROW_HW_ERROR(Error) << "A recording is already running";
+  if(m_rec_compressed)
+    {
+      if(m_acq_started)
+	THROW_HW_ERROR(Error) << "A compressed recording must be started before the acquisition";
+      _startCompressedStream();
+      format = m_stream_format;
+    }
+  m_rec_format = format.fmt.pix;
+  try
+    {
+      m_recorder.open(path);
+    }
+  catch(Exception&)
+    {
+      if(m_stream_compressed)
+	_stopCompressedStream();
+      throw;
+    }
+}
+
+void VideoCtrlObj::stopRecording()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_stream_compressed && m_acq_started)
+    THROW_HW_ERROR(Error) << "A compressed recording must be stopped after the acquisition";
+  m_recorder.close();
+  if(m_stream_compressed)
+    _stopCompressedStream();
+}
+
+void VideoCtrlObj::getRecordingActive(bool& active)
+{
+  active = m_recorder.isOpen();
+}
+
+void VideoCtrlObj::getNbRecordedFrames(int& nb_frames)
+{
+  nb_frames = m_recorder.getNbFrames();
+}
+
+void VideoCtrlObj::getNbRecordingStalls(int& nb_stalls)
+{
+  nb_stalls = m_recorder.getNbStalls();
+}
+
+void VideoCtrlObj::startFrameRing(const std::string& name,int nb_slots)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR2(name,nb_slots);
+
+  VideoMode mode;
+  Size size;
+  getVideoMode(mode);
+  getMaxImageSize(size);
+
+  AutoMutex aLock(m_cond.mutex());
+  // the slots grow if the processed images are larger
+  m_ring.create(name,nb_slots,_video_mode_size(mode,size.getWidth(),size.getHeight()));
+}
+
+void VideoCtrlObj::stopFrameRing()
+{
+  DEB_MEMBER_FUNCT();
+
+  AutoMutex aLock(m_cond.mutex());
+  m_ring.destroy();
+}
+
+void VideoCtrlObj::getFrameRingActive(bool& active)
+{
+  active = m_ring.isOpen();
+}
+
+void VideoCtrlObj::getNbPublishedFrames(int& nb_frames)
+{
+  DEB_MEMBER_FUNCT();
+  AutoMutex aLock(m_cond.mutex());
+  nb_frames = m_ring.getNbPublished();
+  DEB_RETURN() << DEB_VAR1(nb_frames);
+}
+
+/// copy the image handed to Lima to the shared memory ring
+void VideoCtrlObj::_publish(const unsigned char* data,int width,int height,
+			    VideoMode mode)
+{
+  FrameRing::Slot info;
+  memset(&info,0,sizeof(info));
+  info.size = _video_mode_size(mode,width,height);
+  if(!info.size)
+    return;
+  info.video_mode = mode;
+  info.timestamp = m_buffer.timestamp.tv_sec * 1000000000LL +
+    m_buffer.timestamp.tv_usec * 1000LL;
+  info.frame_id = m_acq_frame_id;
+  info.sequence = m_buffer.sequence;
+  info.width = width;
+  info.height = height;
+  m_ring.publish(data,info);
+}
+
+void VideoCtrlObj::setRecordingCompressed(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  AutoMutex aLock(m_cond.mutex());
+  if(m_recorder.isOpen())
+    THROW_HW_ERROR(Error) << "Can't change the recording format while recording";
+  m_rec_compressed = active;
+}
+
+void VideoCtrlObj::getRecordingCompressed(bool& active) const
+{
+  active = m_rec_compressed;
+}
+
+void VideoCtrlObj::setRecordingLiveRate(double rate)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(rate);
+
+  if(rate < 0.)
+    THROW_HW_ERROR(InvalidValue) << "Rate must be positive or 0";
+  m_rec_live_rate = rate;
+}
+
+void VideoCtrlObj::getRecordingLiveRate(double& rate) const
+{
+  rate = m_rec_live_rate;
+}
+
+void VideoCtrlObj::setMetadataActive(bool active)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(active);
+
+  AutoMutex aLock(m_cond.mutex());
+  if(active == m_metadata.isOpen())
+    return;
+  if(m_acq_started || m_streaming)
+    THROW_HW_ERROR(Error) << "Can't change the metadata stream while streaming";
+  if(active)
+    m_metadata.open(Discovery::findMetadataDevice(m_bus_info),
+		    std::max(m_nb_buffers,4));
+  else
+    m_metadata.close();
+}
+
+void VideoCtrlObj::getMetadataActive(bool& active) const
+{
+  active = m_metadata.isOpen();
+}
+
+void VideoCtrlObj::getFrameMetadata(int frame_id,MetadataStream::Frame& metadata)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(frame_id);
+
+  AutoMutex aLock(m_cond.mutex());
+  const MetadataStream::Frame& frame =
+    m_frame_metadata[std::max(frame_id,0) % m_frame_metadata.size()];
+  if(frame_id < 0 || frame.frame_id != frame_id)
+    THROW_HW_ERROR(InvalidValue) << "No metadata for frame " << frame_id;
+  metadata = frame;
+}
+
+void VideoCtrlObj::setDeviceClockFrequency(double frequency)
+{
+  DEB_MEMBER_FUNCT();
+  DEB_PARAM() << DEB_VAR1(frequency);
+
+  if(frequency < 0.)
+    THROW_HW_ERROR(InvalidValue) << "The clock frequency can't be negative";
+  m_metadata.setClockFrequency(frequency);
+}
+
+void VideoCtrlObj::getDeviceClockFrequency(double& frequency) const
+{
+  frequency = m_metadata.getClockFrequency();
+}
+
+/** called by the acquisition thread for each dequeued frame, delivered
+ *  or not, so the metadata buffers are given back at the video pace
+ */
+void VideoCtrlObj::_matchMetadata()
+{
+  DEB_MEMBER_FUNCT();
+
+  m_metadata_found = m_metadata.getFrame(m_buffer.sequence,m_metadata_frame);
+  if(!m_metadata_found)
+    DEB_TRACE() << "No metadata for frame " << m_buffer.sequence;
+}
+
+/// once the frame id is given
+void VideoCtrlObj::_updateMetadata(int frame_id)
+{
+  MetadataStream::Frame& frame = m_frame_metadata[frame_id % m_frame_metadata.size()];
+  frame = m_metadata_frame;
+  frame.frame_id = m_metadata_found ? frame_id : -1;
+}
+
+/// the metadata node of a reopened device, best effort
+void VideoCtrlObj::_reopenMetadata()
+{
+  DEB_MEMBER_FUNCT();
+
+  try
+    {
+      m_metadata.open(Discovery::findMetadataDevice(m_bus_info),
+		      std::max(m_nb_buffers,4));
+    }
+  catch(Exception&)
+    {
+      DEB_WARNING() << "The metadata stream is lost";
+    }
+}
+
+void VideoCtrlObj::_getFormat(struct v4l2_format& format) const
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_stream_compressed)
+    {
+      format = m_decode_format;
+      return;
+    }
+  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if(v4l2_ioctl(m_fd,VIDIOC_G_FMT,&format) == -1)
+    THROW_HW_ERROR(Error) << "Can't get the format: " << strerror(errno);
+}
+
+/** Switch the device to its native MJPEG/JPEG format at the current
+ *  size, the current format is kept to decode the frames for Lima.
+ */
+void VideoCtrlObj::_startCompressedStream()
+{
+  DEB_MEMBER_FUNCT();
+
+  struct v4l2_format format;
+  _getFormat(format);
+
+  unsigned int compressed = 0;
+  struct v4l2_fmtdesc desc;
+  memset(&desc,0,sizeof(desc));
+  desc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  for(desc.index = 0;!compressed && v4l2_ioctl(m_fd,VIDIOC_ENUM_FMT,&desc) != -1;
+      ++desc.index)
+    if(!(desc.flags & V4L2_FMT_FLAG_EMULATED) &&
+       (desc.pixelformat == V4L2_PIX_FMT_MJPEG || desc.pixelformat == V4L2_PIX_FMT_JPEG))
+      compressed = desc.pixelformat;
+  if(!compressed)
+    THROW_HW_ERROR(NotSupported) << "The camera has no compressed format";
+
+  if(!m_decoder && !(m_decoder = v4lconvert_create(m_fd)))
+    THROW_HW_ERROR(Error) << "Can't create the frame decoder";
+
+  struct v4l2_format stream = format;
+  stream.fmt.pix.pixelformat = compressed;
+  stream.fmt.pix.bytesperline = 0;
+  stream.fmt.pix.sizeimage = 0;
+  _unmap();
+  if(v4l2_ioctl(m_fd,VIDIOC_S_FMT,&stream) == -1 ||
+     stream.fmt.pix.pixelformat != compressed ||
+     stream.fmt.pix.width != format.fmt.pix.width ||
+     stream.fmt.pix.height != format.fmt.pix.height)
+    {
+      v4l2_ioctl(m_fd,VIDIOC_S_FMT,&format);
+      _map();
+      THROW_HW_ERROR(NotSupported) << "The compressed format isn't available at "
+				   << format.fmt.pix.width << "x" << format.fmt.pix.height;
+    }
+  _map();
+
+  m_stream_format = stream;
+  m_decode_format = format;
+  m_decode_buffer.resize(format.fmt.pix.sizeimage);
+  m_rec_live_time = 0.;
+  m_stream_compressed = true;
+}
+
+/// back to the format decoded by libv4l2
+void VideoCtrlObj::_stopCompressedStream()
+{
+  DEB_MEMBER_FUNCT();
+
+  m_stream_compressed = false;
+  _unmap();
+  if(v4l2_ioctl(m_fd,VIDIOC_S_FMT,&m_decode_format) == -1)
+    DEB_ERROR() << "Can't restore the format: " << strerror(errno);
+  _map();
+}
+
+unsigned char* VideoCtrlObj::_decode(bool& corrupt)
+{
+  DEB_MEMBER_FUNCT();
+
+  // an acquisition needs every image, only the live display is thinned
+  if(m_live && m_rec_live_rate > 0.)
+    {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC,&now);
+      double now_time = now.tv_sec + now.tv_nsec * 1e-9;
+      if(now_time - m_rec_live_time < 1. / m_rec_live_rate)
+	return NULL;
+      m_rec_live_time = now_time;
+    }
+
+  int ret = v4lconvert_convert(m_decoder,&m_stream_format,&m_decode_format,
+			       m_buffers[m_buffer.index],m_buffer.bytesused,
+			       &m_decode_buffer[0],m_decode_buffer.size());
+  if(ret < 0)
+    {
+      DEB_ERROR() << "Can't decode frame " << m_buffer.sequence << ": "
+		  << v4lconvert_get_error_message(m_decoder);
+      if(!corrupt)
+	++m_nb_corrupt_frames;
+      corrupt = true;
+      return NULL;
+    }
+  return &m_decode_buffer[0];
+}
+
+/// append the dequeued buffer, untouched, to the recording
+void VideoCtrlObj::_record()
+{
+  Recorder::FrameEntry entry;
+  entry.offset = 0;
+  entry.size = m_buffer.bytesused ? m_buffer.bytesused : m_buffer.length;
+  entry.sequence = m_buffer.sequence;
+  entry.timestamp = m_buffer.timestamp.tv_sec * 1000000000LL +
+    m_buffer.timestamp.tv_usec * 1000LL;
+  entry.pixelformat = m_rec_format.pixelformat;
+  entry.width = m_rec_format.width;
+  entry.height = m_rec_format.height;
+  entry.bytesperline = m_rec_format.bytesperline;
+  m_recorder.addFrame(m_buffers[m_buffer.index],entry);
+}
+
+/// delay between the frame timestamp and its delivery to Lima
+void VideoCtrlObj::_updateLatency()
+{
+  if((m_buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) !=
+     V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    return;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  m_display_latency = (now.tv_sec - m_buffer.timestamp.tv_sec) +
+    (now.tv_nsec * 1e-9 - m_buffer.timestamp.tv_usec * 1e-6);
+}
+
+/** Called by the acquisition thread with the processed frame, compute the
+ *  preview if the last one is older than the max rate period.
+ */
+void VideoCtrlObj::_updatePreview(const unsigned char* data,int width,int height)
+{
+  if(m_pixel_type == Kernels::NbPixelType)
+    return;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  double now_time = now.tv_sec + now.tv_nsec * 1e-9;
+  if(m_preview_max_rate > 0. && m_preview_frame_id >= 0 &&
+     now_time - m_preview_time < 1. / m_preview_max_rate)
+    return;
+
+  int factor = m_preview_factor;
+  int preview_width = width / factor,preview_height = height / factor;
+  if(!preview_width || !preview_height)
+    return;
+
+  int depth = m_pixel_type == Kernels::Pixel16 ? 2 : 1;
+  m_preview_buffer.resize(size_t(preview_width) * preview_height * depth);
+  Kernels::getKernels().bin[m_pixel_type](data,width * depth,&m_preview_buffer[0],
+					  preview_width,preview_height,
+					  factor,factor);
+  m_preview_width = preview_width,m_preview_height = preview_height;
+  m_preview_frame_id = m_acq_frame_id;
+  m_preview_time = now_time;
+}
+
+/** Add a processed frame to the current bracket group, return the merged
+ *  image when the group is complete, NULL otherwise. The merged pixels
+ *  are in counts of the longest exposure of the group; those saturated
+ *  in every frame get the saturation level scaled to that exposure.
+ */
+unsigned char* VideoCtrlObj::_mergeHdr(unsigned char* data,int width,int height)
+{
+  // the groups follow the exposure tags: a frame that isn't taken with the
+  // next exposure of the bracket (before the exposure latency, after a
+  // dropped frame) discards the group, a group starts at bracket[0]
+  double exp_time = m_frame_exp_time;
+  long long exp_value = _exp_time_2_v4l2(exp_time);
+  if(exp_value != _exp_time_2_v4l2(m_exp_bracket[m_hdr_nb_frames]))
+    {
+      _extendCapture(m_hdr_nb_frames);
+      m_hdr_nb_frames = 0;
+      if(exp_value != _exp_time_2_v4l2(m_exp_bracket[0]))
+	{
+	  _extendCapture(1);
+	  return NULL;
+	}
+    }
+
+  const Kernels::Table& kernels = Kernels::getKernels();
+  int nb_pixels = width * height;
+  if(!m_hdr_nb_frames)
+    {
+      m_hdr_sum.assign(nb_pixels,0.f);
+      m_hdr_weight.assign(nb_pixels,0.f);
+      m_hdr_min_exp_time = m_hdr_max_exp_time = exp_time;
+    }
+  else
+    {
+      m_hdr_min_exp_time = std::min(m_hdr_min_exp_time,exp_time);
+      m_hdr_max_exp_time = std::max(m_hdr_max_exp_time,exp_time);
+    }
+
+  float saturation = float(m_hdr_saturation ? m_hdr_saturation : m_pixel_max);
+  kernels.hdr_acc[m_pixel_type](data,nb_pixels,float(exp_time),saturation,
+				&m_hdr_sum[0],&m_hdr_weight[0]);
+  if(++m_hdr_nb_frames < int(m_exp_bracket.size()))
+    return NULL;
+
+  m_hdr_nb_frames = 0;
+  __atomic_add_fetch(&m_hdr_nb_images,1,__ATOMIC_RELEASE);
+  m_hdr_image.resize(nb_pixels);
+  kernels.hdr_merge(&m_hdr_sum[0],&m_hdr_weight[0],nb_pixels,
+		    float(m_hdr_max_exp_time),
+		    float(saturation * m_hdr_max_exp_time / m_hdr_min_exp_time),
+		    &m_hdr_image[0]);
+  return (unsigned char*)&m_hdr_image[0];
+}
+
+/** HDR merge: the frames merged in no image are captured on top of the
+ *  requested ones, the buffers kept for the last frames are queued again.
+ */
+void VideoCtrlObj::_extendCapture(int nb_frames)
+{
+  if(!nb_frames || !m_nb_capture_frames)
+    return;
+
+  m_nb_capture_frames += nb_frames;
+  struct v4l2_buffer buffer = m_buffer;
+  for(unsigned i = 0;i < m_buffers.size();++i)
+    if(!m_buffer_queued[i] && i != m_buffer.index)
+      {
+	buffer.index = i;
+	_queueBuffer(buffer);
+      }
+}
+
+/** Add a processed frame (the mmap buffer itself when there is no
+ *  conversion, binning nor roi) to the 32 bits sum, return the sum or the
+ *  average after m_acc_nb_frames frames, NULL otherwise.
+ */
+unsigned char* VideoCtrlObj::_accumulate(unsigned char* data,int width,int height)
+{
+  const Kernels::Table& kernels = Kernels::getKernels();
+  int nb_pixels = width * height;
+  if(!m_acc_count)
+    m_acc_buffer.assign(nb_pixels,0);
+  kernels.acc[m_pixel_type](data,nb_pixels,&m_acc_buffer[0]);
+  if(++m_acc_count < m_acc_nb_frames)
+    return NULL;
+
+  m_acc_count = 0;
+  if(!m_acc_average)
+    return (unsigned char*)&m_acc_buffer[0];
+
+  int depth = m_pixel_type == Kernels::Pixel16 ? 2 : 1;
+  m_acc_image.resize(size_t(nb_pixels) * depth);
+  kernels.avg[m_pixel_type](&m_acc_buffer[0],nb_pixels,m_acc_nb_frames,&m_acc_image[0]);
+  return &m_acc_image[0];
+}
+
+void VideoCtrlObj::_getProcessedSize(Size& size)
+{
+  getMaxImageSize(size);
+  if(m_pixel_type == Kernels::NbPixelType)
+    return;
+  if(!m_roi.isEmpty())
+    size = m_roi.getSize();
+  else
+    size = Size(size.getWidth() / m_bin.getX(),size.getHeight() / m_bin.getY());
+}
+
+/** Called by the acquisition thread while a reference is captured, the
+ *  processed frames are summed until the capture ends.
+ */
+void VideoCtrlObj::_captureReference(const unsigned char* data,int width,int height)
+{
+  int nb_pixels = width * height;
+  if(!m_ref_count || width != m_ref_width || height != m_ref_height)
+    {
+      m_ref_acc.assign(nb_pixels,0);
+      m_ref_count = 0;
+      m_ref_width = width,m_ref_height = height;
+    }
+  if(m_ref_count >= 32768)	// keep the sum below 2^31
+    return;
+  Kernels::getKernels().acc[m_pixel_type](data,nb_pixels,&m_ref_acc[0]);
+  ++m_ref_count;
+}
+
+/// store the average of the captured frames as the reference
+void VideoCtrlObj::_endReferenceCapture()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(m_ref_capture == NoReference || !m_ref_count)
+    return;
+
+  _Reference& reference = m_refs[m_ref_capture];
+  reference.width = m_ref_width,reference.height = m_ref_height;
+  reference.data.resize(m_ref_acc.size());
+  for(size_t i = 0;i < m_ref_acc.size();++i)
+    reference.data[i] = float(double(m_ref_acc[i]) / m_ref_count);
+  DEB_TRACE() << "Reference " << m_ref_capture << " from " << m_ref_count << " frames";
+
+  m_ref_count = 0;
+  std::vector<unsigned int>().swap(m_ref_acc);
+}
+
+/** Build the dark and gain planes used by the correction kernel:
+ *  gain = mean(flat - dark) / (flat - dark), 0 for dead pixels.
+ */
+void VideoCtrlObj::_prepareCorrection()
+{
+  DEB_MEMBER_FUNCT();
+
+  if(!m_corr_active)
+    return;
+  if(_isY32Output() || m_pixel_type == Kernels::NbPixelType)
+    THROW_HW_ERROR(Error) << "Correction needs Y8 or Y16 images";
+
+  Size size;
+  _getProcessedSize(size);
+  AutoMutex aLock(m_cond.mutex());
+  const _Reference& dark = m_refs[DarkReference];
+  const _Reference& flat = m_refs[FlatReference];
+  if(dark.data.empty() && flat.data.empty())
+    THROW_HW_ERROR(Error) << "No dark nor flat reference";
+  for(int r = DarkReference;r <= FlatReference;++r)
+    {
+      const _Reference& reference = m_refs[r];
+      if(!reference.data.empty() &&
+	 (reference.width != size.getWidth() || reference.height != size.getHeight()))
+	THROW_HW_ERROR(Error) << "Reference " << r << " size ("
+			      << reference.width << "x" << reference.height
+			      << ") doesn't match the image size " << size;
+    }
+
+  size_t nb_pixels = size_t(size.getWidth()) * size.getHeight();
+  if(dark.data.empty())
+    m_corr_dark.assign(nb_pixels,0.f);
+  else
+    m_corr_dark = dark.data;
+
+  if(flat.data.empty())
+    m_corr_gain.assign(nb_pixels,1.f);
+  else
+    {
+      m_corr_gain.resize(nb_pixels);
+      double sum = 0.;
+      for(size_t i = 0;i < nb_pixels;++i)
+	sum += m_corr_gain[i] = flat.data[i] - m_corr_dark[i];
+      float mean = float(sum / nb_pixels);
+      for(size_t i = 0;i < nb_pixels;++i)
+	m_corr_gain[i] = m_corr_gain[i] > 0.f ? mean / m_corr_gain[i] : 0.f;
+    }
+}
+
+unsigned char* VideoCtrlObj::_correct(unsigned char* data,int width,int height)
+{
+  int nb_pixels = width * height;
+  m_corr_image.resize(nb_pixels);
+  Kernels::getKernels().flat_field[m_pixel_type](data,nb_pixels,
+						 &m_corr_dark[0],&m_corr_gain[0],
+						 &m_corr_image[0]);
+  return (unsigned char*)&m_corr_image[0];
+}
+
+/** Resolve the per frame processing for the prepared acquisition: the
+ *  kernels for the pixel type and binning, the roi offset and the output
+ *  geometry, so the acquisition thread neither queries the format nor
+ *  branches on it for each frame.
+ */
+void VideoCtrlObj::_prepareFramePath()
+{
+  DEB_MEMBER_FUNCT();
+
+  const Kernels::Table& kernels = Kernels::getKernels();
+  _FramePath& path = m_path;
+  getVideoMode(path.mode);
+  Size size;
+  getMaxImageSize(size);
+  path.width = path.out_width = size.getWidth();
+  path.height = path.out_height = size.getHeight();
+  path.conv = m_conv_func;
+  path.stride = m_conv_func ? 0 : m_bytes_per_line;
+  path.depth = 0;
+  path.offset = 0;
+  path.crop = NULL;
+  path.bin = NULL;
+  path.stat = NULL;
+  if(m_pixel_type != Kernels::NbPixelType)
+    {
+      path.depth = m_pixel_type == Kernels::Pixel16 ? 2 : 1;
+      if(!path.stride)
+	path.stride = path.width * path.depth;
+      path.stat = kernels.stat[m_pixel_type];
+      if(!m_bin.isOne() || !m_roi.isEmpty())
+	{
+	  int bin_x = m_bin.getX(),bin_y = m_bin.getY();
+	  Roi roi = m_roi.isEmpty() ? Roi(0,0,path.width / bin_x,path.height / bin_y) : m_roi;
+	  Point tl = roi.getTopLeft();
+	  path.out_width = roi.getSize().getWidth();
+	  path.out_height = roi.getSize().getHeight();
+	  path.offset = size_t(tl.getY()) * bin_y * path.stride + tl.getX() * bin_x * path.depth;
+	  if(m_bin.isOne())
+	    path.crop = kernels.crop;
+	  else
+	    path.bin = Kernels::getBinFunc(m_pixel_type,bin_x,bin_y);
+	  size_t proc_size = size_t(path.out_width) * path.out_height * path.depth;
+	  if(m_proc_buffer.size() < proc_size)
+	    m_proc_buffer.resize(proc_size);
+	}
+    }
+  DEB_TRACE() << DEB_VAR3(path.mode,path.out_width,path.out_height);
+}
+
+/** Apply the software conversion, binning and roi on a captured buffer
+ *  along the prepared frame path, width and height are set to the
+ *  delivered image size.
+ */
+unsigned char* VideoCtrlObj::_processImage(unsigned char* data,int& width,int& height)
+{
+  const _FramePath& path = m_path;
+  if(path.conv)
+    {
+      path.conv(data,m_conv_src_stride,&m_conv_buffer[0],path.width,path.height);
+      data = &m_conv_buffer[0];
+    }
+  if(path.bin)
+    {
+      path.bin(data + path.offset,path.stride,&m_proc_buffer[0],
+	       path.out_width,path.out_height,m_bin.getX(),m_bin.getY());
+      data = &m_proc_buffer[0];
+    }
+  else if(path.crop)
+    {
+      path.crop(data + path.offset,path.stride,&m_proc_buffer[0],
+		path.out_width * path.depth,path.out_height);
+      data = &m_proc_buffer[0];
+    }
+  width = path.out_width,height = path.out_height;
+
+  if(path.stat && m_stat_active)
+    path.stat(data,width,height,m_last_stat);
+  return data;
+}
+
+void VideoCtrlObj::_unmap()
+{
+  DEB_MEMBER_FUNCT();
+  if(m_buffers.empty()) return;			// nothing to free
+
+  _streamOff();
+
+  for(unsigned i = 0;i < m_buffers.size();++i)
+    if(v4l2_munmap(m_buffers[i], m_buffer.length))
+      DEB_ERROR() << "unmapping error: " << strerror(errno);
+  m_buffers.clear();
+  m_buffer_queued.clear();
+
+  struct v4l2_requestbuffers requestbuff;
+  requestbuff.count = 0;
+  requestbuff.type = m_buffer.type;
+  requestbuff.memory = V4L2_MEMORY_MMAP;
+  int ret = v4l2_ioctl(m_fd,VIDIOC_REQBUFS,&requestbuff);
+  if(ret == -1)
+    THROW_HW_ERROR(Error) << "req. buffers: " << strerror(errno);
+}
+
+void VideoCtrlObj::_map()
+{
+  DEB_MEMBER_FUNCT();
 
   struct v4l2_requestbuffers requestbuff;
-  requestbuff.count = sizeof(m_buffers) / sizeof(unsigned char*);
+  requestbuff.count = m_nb_buffers;
   requestbuff.type = m_buffer.type;
   requestbuff.memory = V4L2_MEMORY_MMAP;
   int ret = v4l2_ioctl(m_fd,VIDIOC_REQBUFS,&requestbuff);
 
   if(ret == -1)
     THROW_HW_ERROR(Error) << "req. buffers: " << strerror(errno);
+  // the driver may allocate a different number of buffers
+  DEB_TRACE() << DEB_VAR2(m_nb_buffers,requestbuff.count);
 
-  for (unsigned int i = 0;i < sizeof(m_buffers) / sizeof(unsigned char*);++i)
+  for (unsigned int i = 0;i < requestbuff.count;++i)
     {
       m_buffer.index = i;
       ret = v4l2_ioctl(m_fd, VIDIOC_QUERYBUF, &m_buffer);
@@ -746,18 +3352,32 @@ void VideoCtrlObj::_map()
 	THROW_HW_ERROR(Error)<< "memory type " 
 			     << m_buffer.memory << ": not MMAP";
 			
+      // pages are faulted in by the first capture, unless prefault is asked
       int prot_flags = PROT_READ | PROT_WRITE;
+      int map_flags = MAP_SHARED | (m_buffer_prefault ? MAP_POPULATE : 0);
       void *p = v4l2_mmap(NULL, m_buffer.length, prot_flags, 
-			  MAP_SHARED, m_fd, m_buffer.m.offset);
+			  map_flags, m_fd, m_buffer.m.offset);
       if (p == MAP_FAILED) 
 	THROW_HW_ERROR(Error) << "mapping buffer " 
 			      << i << ": " << strerror(errno);
-      memset(p, 0, m_buffer.length);
-      m_buffers[i] = (unsigned char *)p;
+      if(m_buffer_prefault)
+	_prefault(p,m_buffer.length);
+      m_buffers.push_back((unsigned char *)p);
     }
+  m_buffer_queued.assign(m_buffers.size(),false);
+}
 
+/// libv4l2 conversion buffers ignore MAP_POPULATE, the advice covers them
+void VideoCtrlObj::_prefault(void* p,size_t length)
+{
+  DEB_MEMBER_FUNCT();
 
-
+#ifdef MADV_POPULATE_WRITE
+  if(!madvise(p,length,MADV_POPULATE_WRITE))
+    return;
+#endif
+  if(madvise(p,length,MADV_WILLNEED))
+    DEB_WARNING() << "Can't prefault buffer: " << strerror(errno);
 }
 //---------------------------
 //- _AcqThread::threadFunction()
@@ -767,8 +3387,7 @@ void VideoCtrlObj::_AcqThread::threadFunction()
   struct pollfd fds[2];
   fds[0].fd = m_video.m_pipes[0];
   fds[0].events = POLLIN;
-  fds[1].fd = m_video.m_fd;
-  fds[1].events = POLLIN;
+  fds[1].events = POLLIN | POLLPRI;
 
   DEB_MEMBER_FUNCT();
   AutoMutex aLock(m_video.m_cond.mutex());
@@ -777,19 +3396,40 @@ void VideoCtrlObj::_AcqThread::threadFunction()
     {
       while(!m_video.m_acq_started && !m_video.m_quit)
 	{
-	  m_video.m_acq_thread_run = false;
+	  if(m_video.m_acq_thread_run)
+	    {
+	      // acquisition end, for waitAcqEnd
+	      __atomic_store_n(&m_video.m_acq_thread_run,false,__ATOMIC_RELEASE);
+	      m_video.m_cond.broadcast();
+	    }
 	  m_video.m_cond.wait();
 	}
-      m_video.m_acq_thread_run = true;
+      __atomic_store_n(&m_video.m_acq_thread_run,true,__ATOMIC_RELEASE);
       if(m_video.m_quit) return;
 
       bool continueAcq = true;
 
       while(continueAcq && 
-	    (!m_video.m_nb_frames || m_video.m_acq_frame_id < (m_video.m_nb_frames - 1)))
+	    (!m_video.m_nb_capture_frames ||
+	     m_video.m_acq_frame_id < (m_video.m_nb_capture_frames - 1)))
 	{
+	  // changed by _reopen
+	  fds[1].fd = m_video.m_fd;
 	  aLock.unlock();
-	  poll(fds,2,-1);
+	  int nb_events = poll(fds,2,m_video.m_poll_timeout);
+	  if(nb_events < 0)
+	    {
+	      // interrupted by a signal
+	      aLock.lock();
+	      continue;
+	    }
+	  else if(!nb_events)
+	    {
+	      aLock.lock();
+	      DEB_WARNING() << "No frame within " << m_video.m_poll_timeout << " ms";
+	      continueAcq = m_video._recover(ETIMEDOUT);
+	      continue;
+	    }
 
 	  if(fds[0].revents)
 	    {
@@ -801,35 +3441,120 @@ void VideoCtrlObj::_AcqThread::threadFunction()
 	    }
 	  else
 	    {
+	      if(fds[1].revents & POLLPRI)
+		{
+		  m_video.m_controls.processEvents();
+		  if(!(fds[1].revents & ~POLLPRI))
+		    {
+		      aLock.lock();
+		      continue;
+		    }
+		}
 	      int ret = v4l2_ioctl(m_video.m_fd,VIDIOC_DQBUF,&m_video.m_buffer);
 	      if(ret == -1)
 		{
-		  DEB_ERROR() << "Error dequeue buff : " << strerror(errno);
-		  continueAcq = false;
+		  int error = errno;
+		  aLock.lock();
+		  // the fd is blocking: after a frame event, EAGAIN is a
+		  // frame libv4l2 couldn't decode (short or broken MJPEG),
+		  // its buffer is already requeued
+		  if(error == EAGAIN && (fds[1].revents & POLLIN))
+		    {
+		      ++m_video.m_nb_corrupt_frames;
+		      DEB_TRACE() << "Corrupt frame (libv4l2 decode error)";
+		    }
+		  // interrupted, or another frame event than expected
+		  if(error == EINTR || error == EAGAIN)
+		    continue;
+		  DEB_ERROR() << "Error dequeue buff : " << strerror(error);
+		  continueAcq = m_video._recover(error);
 		}
 	      else
 		{
 		  aLock.lock();
-		  ++m_video.m_acq_frame_id;
+		  m_video.m_buffer_queued[m_video.m_buffer.index] = false;
+		  m_video.m_nb_failures = 0;
+		  m_video._checkStarvation();
+		  if(m_video.m_live && m_video.m_live_latest)
+		    m_video._dequeueLatest();
+		  if(m_video.m_metadata.isOpen())
+		    m_video._matchMetadata();
+		  if(!m_video._acceptFrame())
+		    {
+		      m_video._queueBuffer(m_video.m_buffer);
+		      continue;
+		    }
+		  bool corrupt = !m_video._checkFrame();
+		  if(corrupt && m_video.m_corrupt_policy != MarkCorruptFrame)
+		    {
+		      // never recorded, decoded nor processed
+		      m_video._queueBuffer(m_video.m_buffer);
+		      if(m_video.m_corrupt_policy == RepeatLastFrame)
+			continueAcq = m_video._repeatLastFrame();
+		      continue;
+		    }
+		  if(m_video.m_recorder.isOpen())
+		    m_video._record();
+		  unsigned char* frame = m_video.m_buffers[m_video.m_buffer.index];
+		  if(m_video.m_stream_compressed && !(frame = m_video._decode(corrupt)))
+		    {
+		      m_video._queueBuffer(m_video.m_buffer);
+		      if(corrupt && m_video.m_corrupt_policy == RepeatLastFrame)
+			continueAcq = m_video._repeatLastFrame();
+		      continue;
+		    }
+		  __atomic_add_fetch(&m_video.m_acq_frame_id,1,__ATOMIC_RELEASE);
 		  DEB_TRACE() << "Acq frame nb : " << m_video.m_acq_frame_id;
-		  VideoMode mode;
-		  Size size;
-		  m_video.getVideoMode(mode);
-		  m_video.getMaxImageSize(size);
-		  continueAcq = m_video.callNewImage((char *)m_video.m_buffers[m_video.m_buffer.index],
-						      size.getWidth(),
-						      size.getHeight(),
-						      mode);
-		  if(!m_video.m_nb_frames ||
-		     m_video.m_acq_frame_id < (m_video.m_nb_frames - sizeof(m_video.m_buffers) / 
-					     sizeof(unsigned char*)))
-		    v4l2_ioctl(m_video.m_fd,VIDIOC_QBUF,&m_video.m_buffer);
+		  m_video._updateExposure(m_video.m_acq_frame_id);
+		  if(corrupt)
+		    m_video.m_exp_tags[m_video.m_acq_frame_id % m_video.m_exp_tags.size()].corrupt = true;
+		  if(m_video.m_metadata.isOpen())
+		    m_video._updateMetadata(m_video.m_acq_frame_id);
+		  VideoMode mode = m_video.m_path.mode;
+		  int width,height;
+		  unsigned char* data =
+		    m_video._processImage(frame,width,height);
+		  if(m_video.m_preview_active)
+		    m_video._updatePreview(data,width,height);
+		  if(m_video.m_ref_capture != NoReference)
+		    m_video._captureReference(data,width,height);
+		  if(m_video.m_hdr_active)
+		    data = m_video._mergeHdr(data,width,height);
+		  else if(m_video.m_acc_nb_frames > 1)
+		    data = m_video._accumulate(data,width,height);
+		  if(data && m_video.m_corr_active)
+		    data = m_video._correct(data,width,height);
+		  if(data)
+		    {
+		      m_video._updateLatency();
+		      if(m_video.m_ring.isOpen())
+			m_video._publish(data,width,height,mode);
+		      if(m_video.m_first_frame_delay < 0.)
+			m_video._updateFirstFrameDelay();
+		      if(m_video.m_corrupt_policy == RepeatLastFrame && !corrupt)
+			{
+			  size_t size = _video_mode_size(mode,width,height);
+			  m_video.m_last_good.assign(data,data + size);
+			  m_video.m_last_good_width = width;
+			  m_video.m_last_good_height = height;
+			  m_video.m_last_good_mode = mode;
+			}
+		      continueAcq = m_video.callNewImage((char *)data,
+							  width,
+							  height,
+							  mode);
+		      // for waitNbHwAcquiredFrames
+		      m_video.m_cond.broadcast();
+		    }
+		  if(!m_video.m_nb_capture_frames || m_video._isTrigMult() ||
+		     m_video.m_acq_frame_id < int(m_video.m_nb_capture_frames - m_video.m_buffers.size()))
+		    m_video._queueBuffer(m_video.m_buffer);
 		}
 	    }
 	}
       m_video.m_acq_started = false;
-      enum v4l2_buf_type buff_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-      if(v4l2_ioctl(m_video.m_fd,VIDIOC_STREAMOFF,&buff_type) == -1)
-	DEB_ERROR() << "Error stopping stream : " << strerror(errno);
+      // a kept stream is reused by the next prepareAcq
+      if(!m_video.m_keep_streaming)
+	m_video._streamOff();
     }
 }
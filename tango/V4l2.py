@@ -40,6 +40,7 @@
 #=============================================================================
 #
 import PyTango
+import numpy
 from Lima import Core
 from Lima import V4l2 as V4l2Acq
 from Lima.Server import AttrHelper
@@ -76,7 +77,64 @@ class V4l2(PyTango.Device_4Impl):
     def getAttrStringValueList(self, attr_name):
         return AttrHelper.get_attr_string_value_list(self, attr_name)
 
+    @Core.DEB_MEMBER_FUNCT
+    def loadReference(self, argin):
+        ref, path = argin
+        _V4l2Interface.loadReference(_ReferenceMap[ref.upper()], path)
+
+    @Core.DEB_MEMBER_FUNCT
+    def saveReference(self, argin):
+        ref, path = argin
+        _V4l2Interface.saveReference(_ReferenceMap[ref.upper()], path)
+
+    @Core.DEB_MEMBER_FUNCT
+    def startRecording(self, path):
+        _V4l2Interface.startRecording(path)
+
+    @Core.DEB_MEMBER_FUNCT
+    def stopRecording(self):
+        _V4l2Interface.stopRecording()
+
+    @Core.DEB_MEMBER_FUNCT
+    def startFrameRing(self, name):
+        _V4l2Interface.startFrameRing(name)
+
+    @Core.DEB_MEMBER_FUNCT
+    def stopFrameRing(self):
+        _V4l2Interface.stopFrameRing()
+
+    @Core.DEB_MEMBER_FUNCT
+    def selectVideoMode(self, argin):
+        mode = getattr(Core, argin[0].upper())
+        limits = [float(x) for x in argin[1:4]]
+        limits += [0.] * (3 - len(limits))
+        _V4l2Interface.selectVideoMode(mode, int(limits[0]), int(limits[1]),
+                                       limits[2])
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_last_image_statistics(self, attr):
+        attr.set_value(list(_V4l2Interface.getLastImageStatistics()))
+
+    @Core.DEB_MEMBER_FUNCT
+    def read_preview_image(self, attr):
+        frame_id, width, height, depth, data = _V4l2Interface.getPreviewImage()
+        enc = PyTango.EncodedAttribute()
+        dtype = numpy.uint8 if depth == 1 else numpy.uint16
+        image = numpy.frombuffer(data, dtype=dtype).reshape(height, width)
+        if depth == 1:
+            enc.encode_gray8(image)
+        else:
+            enc.encode_gray16(image)
+        attr.set_value(enc)
+
     def __getattr__(self,name) :
+        if name in ('read_reference_capture', 'write_reference_capture'):
+            return AttrHelper.get_attr_4u(self, name, _V4l2Interface,
+                                          _ReferenceMap)
+        if name in ('read_corrupt_frame_policy',
+                    'write_corrupt_frame_policy'):
+            return AttrHelper.get_attr_4u(self, name, _V4l2Interface,
+                                          _CorruptFramePolicyMap)
         return AttrHelper.get_attr_4u(self, name, _V4l2Interface)
 
 class V4l2Class(PyTango.DeviceClass):
@@ -87,15 +145,217 @@ class V4l2Class(PyTango.DeviceClass):
        'video_device':
         [PyTango.DevString,
          'video device path', ['/dev/video0']],
+       'video_bus_info':
+        [PyTango.DevString,
+         'bus info or /dev/v4l/by-path name of the device, '
+         'takes precedence over video_device', ['']],
         }
 
     cmd_list = {
         'getAttrStringValueList':
         [[PyTango.DevString, "Attribute name"],
          [PyTango.DevVarStringArray, "Authorized String value list"]],
+        'loadReference':
+        [[PyTango.DevVarStringArray, "[DARK|FLAT, file path]"],
+         [PyTango.DevVoid, ""]],
+        'saveReference':
+        [[PyTango.DevVarStringArray, "[DARK|FLAT, file path]"],
+         [PyTango.DevVoid, ""]],
+        'startRecording':
+        [[PyTango.DevString, "raw file path"],
+         [PyTango.DevVoid, ""]],
+        'stopRecording':
+        [[PyTango.DevVoid, ""],
+         [PyTango.DevVoid, ""]],
+        'startFrameRing':
+        [[PyTango.DevString, "shared memory name"],
+         [PyTango.DevVoid, ""]],
+        'stopFrameRing':
+        [[PyTango.DevVoid, ""],
+         [PyTango.DevVoid, ""]],
+        'selectVideoMode':
+        [[PyTango.DevVarStringArray,
+          "[video mode, min width, min height, min fps]"],
+         [PyTango.DevVoid, ""]],
         }
 
     attr_list = {
+        'statistics_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'last_image_statistics':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ, 3]],
+        'exposure_bracket':
+        [[PyTango.DevDouble,
+          PyTango.SPECTRUM,
+          PyTango.READ_WRITE, 64]],
+        'exposure_latency':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'hdr_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'hdr_saturation':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'acc_nb_frames':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'acc_average':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'correction_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'reference_capture':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'nb_buffers':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'keep_streaming':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'first_frame_delay':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'buffer_prefault':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'mode_switch_time':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'frame_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'decode_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'live_latest_frame':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'display_latency':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'nb_skipped_frames':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'max_buffer_memory':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'nb_starvations':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'min_queued_buffers':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'nb_dropped_frames':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'frame_timeout':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'reconnect_timeout':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'nb_stream_restarts':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'nb_reconnects':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'nb_frame_errors':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'corrupt_frame_policy':
+        [[PyTango.DevString,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'nb_corrupt_frames':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'metadata_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'device_clock_frequency':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'preview_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'preview_factor':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'preview_max_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'preview_image':
+        [[PyTango.DevEncoded,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'recording_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'nb_recorded_frames':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'nb_recording_stalls':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'recording_compressed':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'recording_live_rate':
+        [[PyTango.DevDouble,
+          PyTango.SCALAR,
+          PyTango.READ_WRITE]],
+        'frame_ring_active':
+        [[PyTango.DevBoolean,
+          PyTango.SCALAR,
+          PyTango.READ]],
+        'nb_published_frames':
+        [[PyTango.DevLong,
+          PyTango.SCALAR,
+          PyTango.READ]],
         }
 
     def __init__(self,name) :
@@ -107,9 +367,19 @@ class V4l2Class(PyTango.DeviceClass):
 #----------------------------------------------------------------------------
 _V4l2Interface = None
 
-def get_control(video_device='/dev/video0', **keys) :
+_ReferenceMap = {'NONE': V4l2Acq.NoReference,
+                 'DARK': V4l2Acq.DarkReference,
+                 'FLAT': V4l2Acq.FlatReference}
+
+_CorruptFramePolicyMap = {'DROP': V4l2Acq.DropCorruptFrame,
+                          'REPEAT': V4l2Acq.RepeatLastFrame,
+                          'MARK': V4l2Acq.MarkCorruptFrame}
+
+def get_control(video_device='/dev/video0', video_bus_info='', **keys) :
     global _V4l2Interface
     if _V4l2Interface is None:
+        if video_bus_info:
+            video_device = V4l2Acq.Discovery.findDevice(video_bus_info)
         _V4l2Interface = V4l2Acq.Interface(video_device)
     return Core.CtControl(_V4l2Interface)
 
@@ -0,0 +1,166 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// The shared memory frame ring from a writer to a reader of the same
+// process: frames read back in order with their fields, a reader left
+// behind losing the overwritten frames, seekLatest, and the ring
+// replaced by a larger one when a bigger frame is published (the frame
+// counts go on and the readers follow it).
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "V4L2FrameRing.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+static int nb_failures = 0;
+
+#define CHECK(cond)						\
+  do {								\
+    if(!(cond))							\
+      {								\
+	printf("FAILED: %s (line %d)\n",#cond,__LINE__);	\
+	++nb_failures;						\
+      }								\
+  } while(0)
+
+static std::vector<unsigned char> _frame(int frame_id,size_t size)
+{
+  std::vector<unsigned char> data(size);
+  for(size_t i = 0;i < size;++i)
+    data[i] = (unsigned char)(frame_id * 7 + i);
+  return data;
+}
+
+static void _publish(FrameRing& ring,int frame_id,size_t size)
+{
+  std::vector<unsigned char> data = _frame(frame_id,size);
+  FrameRing::Slot info;
+  memset(&info,0,sizeof(info));
+  info.video_mode = 2;
+  info.timestamp = 1000LL * frame_id;
+  info.frame_id = frame_id;
+  info.sequence = frame_id + 10;
+  info.width = size;
+  info.height = 1;
+  info.size = size;
+  CHECK(ring.publish(&data[0],info));
+}
+
+// next frame of the reader must be frame_id, released intact
+static void _read(FrameRingReader& reader,int frame_id,size_t size)
+{
+  const unsigned char* data;
+  FrameRing::Slot info;
+  if(!reader.acquire(data,info))
+    {
+      printf("FAILED: frame %d not acquired\n",frame_id);
+      ++nb_failures;
+      return;
+    }
+  std::vector<unsigned char> ref = _frame(frame_id,size);
+  CHECK(info.frame_id == frame_id);
+  CHECK(info.count == uint64_t(frame_id));
+  CHECK(info.sequence == uint32_t(frame_id + 10));
+  CHECK(info.timestamp == 1000LL * frame_id);
+  CHECK(info.video_mode == 2);
+  CHECK(info.size == size && info.width == size && info.height == 1);
+  CHECK(!memcmp(data,&ref[0],size));
+  CHECK(reader.release());
+}
+
+int main()
+{
+  char name[64];
+  snprintf(name,sizeof(name),"/lima_v4l2_test_%d",int(getpid()));
+  const int nb_slots = 4;
+  const size_t size = 1000;
+
+  try
+    {
+      FrameRing ring;
+      ring.create(name,nb_slots,size);
+      CHECK(ring.isOpen());
+      FrameRingReader reader(name);
+
+      // nothing published yet
+      const unsigned char* data;
+      FrameRing::Slot info;
+      CHECK(!reader.acquire(data,info));
+      CHECK(!reader.release());
+
+      // in order
+      for(int i = 0;i < 3;++i)
+	_publish(ring,i,size);
+      for(int i = 0;i < 3;++i)
+	_read(reader,i,size);
+      CHECK(!reader.acquire(data,info));
+      CHECK(reader.getNbLost() == 0);
+
+      // overrun: frames 3 and 4 are overwritten before they are read
+      for(int i = 3;i < 3 + nb_slots + 2;++i)
+	_publish(ring,i,size);
+      _read(reader,5,size);
+      CHECK(reader.getNbLost() == 2);
+      for(int i = 6;i < 3 + nb_slots + 2;++i)
+	_read(reader,i,size);
+
+      // a frame overwritten while it is acquired
+      _publish(ring,9,size);
+      CHECK(reader.acquire(data,info) && info.frame_id == 9);
+      for(int i = 10;i < 10 + nb_slots;++i)
+	_publish(ring,i,size);
+      CHECK(!reader.release());
+      CHECK(reader.getNbLost() == 3);
+
+      // the cursor goes to the newest frame
+      reader.seekLatest();
+      _read(reader,10 + nb_slots - 1,size);
+      CHECK(ring.getNbPublished() == 10 + nb_slots);
+
+      // a larger frame replaces the ring, the reader follows it
+      FrameRingReader late_reader(name);
+      _publish(ring,20,3 * size);
+      CHECK(reader.acquire(data,info) && info.frame_id == 20 &&
+	    info.size == 3 * size && info.count == uint64_t(10 + nb_slots));
+      CHECK(reader.release());
+      CHECK(late_reader.acquire(data,info) && info.frame_id == 20);
+      CHECK(late_reader.release());
+
+      ring.destroy();
+      CHECK(!ring.isOpen());
+      CHECK(!reader.acquire(data,info));
+    }
+  catch(Exception&)
+    {
+      printf("FAILED: exception\n");
+      ++nb_failures;
+    }
+
+  if(nb_failures)
+    printf("%d failures\n",nb_failures);
+  return nb_failures ? 1 : 0;
+}
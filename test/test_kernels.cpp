@@ -0,0 +1,298 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// The SIMD kernels against the scalar ones: every level compiled in the
+// plugin and supported by this cpu must give the same output on random
+// images, with sizes that exercise the tails of the vector loops and
+// padded source lines. Destination buffers are compared beyond their
+// end to catch overruns.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "V4L2PixelKernels.h"
+
+using namespace lima::V4L2;
+
+static int nb_failures = 0;
+
+static void _check(bool ok,const char* kernel,Kernels::SimdLevel level,
+		   int width,int height)
+{
+  if(ok)
+    return;
+  printf("FAILED: %s %s %dx%d\n",kernel,Kernels::getSimdLevelName(level),
+	 width,height);
+  ++nb_failures;
+}
+
+static void _fill(std::vector<unsigned char>& buffer,size_t size)
+{
+  buffer.resize(size);
+  for(size_t i = 0;i < size;++i)
+    buffer[i] = (unsigned char)rand();
+}
+
+static void _fill(std::vector<float>& buffer,size_t size,float min,float max)
+{
+  buffer.resize(size);
+  for(size_t i = 0;i < size;++i)
+    buffer[i] = min + (max - min) * rand() / RAND_MAX;
+}
+
+// destination with room for an overrun, same guard bytes at every level
+struct Output
+{
+  enum {Guard = 64};
+
+  Output(size_t size) : m_size(size),m_data(size + Guard,0xa5) {}
+  unsigned char* get() { return &m_data[0]; }
+  bool operator==(const Output& o) const { return m_data == o.m_data; }
+
+  size_t			m_size;
+  std::vector<unsigned char>	m_data;
+};
+
+static const int widths[] = {2,3,7,16,31,64,65,333,1024,1031};
+static const int heights[] = {2,5};
+static const int nb_widths = sizeof(widths) / sizeof(int);
+static const int nb_heights = sizeof(heights) / sizeof(int);
+
+static void _test_conv(const Kernels::Table& scalar,const Kernels::Table& simd,
+		       Kernels::SimdLevel level)
+{
+  for(int k = 0;k < Kernels::NbKernel;++k)
+    for(int w = 0;w < nb_widths;++w)
+      for(int h = 0;h < nb_heights;++h)
+	{
+	  Kernels::Kernel kernel = Kernels::Kernel(k);
+	  int width = widths[w],height = heights[h];
+	  int src_stride = Kernels::getSrcLineSize(kernel,width) + 11;
+	  std::vector<unsigned char> src;
+	  _fill(src,size_t(src_stride) * height);
+	  size_t size = size_t(width) * height * Kernels::getDstPixelDepth(kernel);
+	  Output ref(size),out(size);
+	  scalar.conv[k](&src[0],src_stride,ref.get(),width,height);
+	  simd.conv[k](&src[0],src_stride,out.get(),width,height);
+	  _check(ref == out,Kernels::getKernelName(kernel),level,width,height);
+	}
+}
+
+static void _test_crop(const Kernels::Table& scalar,const Kernels::Table& simd,
+		       Kernels::SimdLevel level)
+{
+  for(int w = 0;w < nb_widths;++w)
+    for(int h = 0;h < nb_heights;++h)
+      {
+	int line_size = widths[w],height = heights[h];
+	int src_stride = line_size * 2 + 5;
+	std::vector<unsigned char> src;
+	_fill(src,size_t(src_stride) * height);
+	Output ref(size_t(line_size) * height),out(size_t(line_size) * height);
+	scalar.crop(&src[0] + 3,src_stride,ref.get(),line_size,height);
+	simd.crop(&src[0] + 3,src_stride,out.get(),line_size,height);
+	_check(ref == out,"crop",level,line_size,height);
+      }
+}
+
+static void _test_bin(const Kernels::Table& scalar,const Kernels::Table& simd,
+		      Kernels::SimdLevel level)
+{
+  // generic kernel (with more than 4096 source columns), then the
+  // specializations
+  static const int bins[][2] = {{2,2},{3,2},{1,4},{4,4},{16,16}};
+  static const int out_widths[] = {1,3,17,100,3000};
+  for(int t = 0;t < Kernels::NbPixelType;++t)
+    for(int b = 0;b < int(sizeof(bins) / sizeof(bins[0]));++b)
+      for(int w = 0;w < int(sizeof(out_widths) / sizeof(int));++w)
+	{
+	  int depth = t == Kernels::Pixel16 ? 2 : 1;
+	  int bin_x = bins[b][0],bin_y = bins[b][1];
+	  int width = out_widths[w],height = 3;
+	  int src_stride = width * bin_x * depth + 2 * depth;
+	  std::vector<unsigned char> src;
+	  _fill(src,size_t(src_stride) * height * bin_y);
+	  size_t size = size_t(width) * height * depth;
+
+	  Output ref(size),out(size);
+	  scalar.bin[t](&src[0],src_stride,ref.get(),width,height,bin_x,bin_y);
+	  simd.bin[t](&src[0],src_stride,out.get(),width,height,bin_x,bin_y);
+	  _check(ref == out,"bin",level,width,height);
+
+	  Kernels::BinFunc scalar_fixed = NULL,simd_fixed = NULL;
+	  if(bin_x == 2 && bin_y == 2)
+	    scalar_fixed = scalar.bin2x2[t],simd_fixed = simd.bin2x2[t];
+	  else if(bin_x == 4 && bin_y == 4)
+	    scalar_fixed = scalar.bin4x4[t],simd_fixed = simd.bin4x4[t];
+	  if(!scalar_fixed)
+	    continue;
+	  // the specialization must also match the generic kernel
+	  Output fixed_ref(size),fixed_out(size);
+	  scalar_fixed(&src[0],src_stride,fixed_ref.get(),width,height,bin_x,bin_y);
+	  simd_fixed(&src[0],src_stride,fixed_out.get(),width,height,bin_x,bin_y);
+	  _check(fixed_ref == ref && fixed_out == ref,"bin fixed",level,width,height);
+	}
+}
+
+static void _test_stat(const Kernels::Table& scalar,const Kernels::Table& simd,
+		       Kernels::SimdLevel level)
+{
+  for(int t = 0;t < Kernels::NbPixelType;++t)
+    for(int w = 0;w < nb_widths;++w)
+      for(int h = 0;h < nb_heights;++h)
+	{
+	  int depth = t == Kernels::Pixel16 ? 2 : 1;
+	  int width = widths[w],height = heights[h];
+	  std::vector<unsigned char> src;
+	  _fill(src,size_t(width) * height * depth);
+	  Kernels::Statistics ref,out;
+	  scalar.stat[t](&src[0],width,height,ref);
+	  simd.stat[t](&src[0],width,height,out);
+	  _check(ref.min == out.min && ref.max == out.max && ref.mean == out.mean,
+		 "stat",level,width,height);
+	}
+}
+
+// floating point sums: FMA contractions may change the last bits
+static bool _close(const std::vector<float>& a,const std::vector<float>& b)
+{
+  for(size_t i = 0;i < a.size();++i)
+    if(fabsf(a[i] - b[i]) > 1e-5f * fabsf(a[i]) + 1e-6f)
+      return false;
+  return true;
+}
+
+static void _test_hdr(const Kernels::Table& scalar,const Kernels::Table& simd,
+		      Kernels::SimdLevel level)
+{
+  for(int t = 0;t < Kernels::NbPixelType;++t)
+    for(int w = 0;w < nb_widths;++w)
+      {
+	int depth = t == Kernels::Pixel16 ? 2 : 1;
+	int nb_pixels = widths[w] * 3;
+	std::vector<unsigned char> src;
+	_fill(src,size_t(nb_pixels) * depth);
+	// some pixels at or above saturation
+	float saturation = t == Kernels::Pixel16 ? 60000.f : 240.f;
+	std::vector<float> sum,weight;
+	_fill(sum,nb_pixels,0.f,1e6f);
+	_fill(weight,nb_pixels,0.f,100.f);
+	std::vector<float> ref_sum = sum,ref_weight = weight;
+	scalar.hdr_acc[t](&src[0],nb_pixels,2e-3f,saturation,&ref_sum[0],&ref_weight[0]);
+	simd.hdr_acc[t](&src[0],nb_pixels,2e-3f,saturation,&sum[0],&weight[0]);
+	_check(_close(ref_sum,sum) && _close(ref_weight,weight),"hdr acc",level,nb_pixels,1);
+      }
+
+  for(int w = 0;w < nb_widths;++w)
+    {
+      int nb_pixels = widths[w] * 3;
+      std::vector<float> sum,weight;
+      _fill(sum,nb_pixels,0.f,1e6f);
+      _fill(weight,nb_pixels,-1.f,100.f);	// negative: all frames saturated
+      Output ref(size_t(nb_pixels) * 4),out(size_t(nb_pixels) * 4);
+      scalar.hdr_merge(&sum[0],&weight[0],nb_pixels,1e-2f,65535.f,(unsigned int*)ref.get());
+      simd.hdr_merge(&sum[0],&weight[0],nb_pixels,1e-2f,65535.f,(unsigned int*)out.get());
+      _check(ref == out,"hdr merge",level,nb_pixels,1);
+    }
+}
+
+static void _test_acc(const Kernels::Table& scalar,const Kernels::Table& simd,
+		      Kernels::SimdLevel level)
+{
+  for(int t = 0;t < Kernels::NbPixelType;++t)
+    for(int w = 0;w < nb_widths;++w)
+      {
+	int depth = t == Kernels::Pixel16 ? 2 : 1;
+	int nb_pixels = widths[w] * 3;
+	std::vector<unsigned char> src;
+	_fill(src,size_t(nb_pixels) * depth);
+	std::vector<unsigned int> ref_acc(nb_pixels),acc(nb_pixels);
+	for(int i = 0;i < nb_pixels;++i)
+	  ref_acc[i] = acc[i] = rand() & 0xffffff;
+	scalar.acc[t](&src[0],nb_pixels,&ref_acc[0]);
+	simd.acc[t](&src[0],nb_pixels,&acc[0]);
+	_check(ref_acc == acc,"acc",level,nb_pixels,1);
+
+	// the average of 1000 frames, rounded to nearest
+	for(int i = 0;i < nb_pixels;++i)
+	  acc[i] = rand() % (1000 << (8 * depth));
+	Output ref(size_t(nb_pixels) * depth),out(size_t(nb_pixels) * depth);
+	scalar.avg[t](&acc[0],nb_pixels,1000,ref.get());
+	simd.avg[t](&acc[0],nb_pixels,1000,out.get());
+	_check(ref == out,"avg",level,nb_pixels,1);
+      }
+}
+
+static void _test_flat_field(const Kernels::Table& scalar,const Kernels::Table& simd,
+			     Kernels::SimdLevel level)
+{
+  for(int t = 0;t < Kernels::NbPixelType;++t)
+    for(int w = 0;w < nb_widths;++w)
+      {
+	int depth = t == Kernels::Pixel16 ? 2 : 1;
+	int nb_pixels = widths[w] * 3;
+	std::vector<unsigned char> src;
+	_fill(src,size_t(nb_pixels) * depth);
+	// results below 0 and above 65535 are clipped
+	std::vector<float> dark,gain;
+	_fill(dark,nb_pixels,0.f,50.f);
+	_fill(gain,nb_pixels,0.f,300.f);
+	Output ref(size_t(nb_pixels) * 2),out(size_t(nb_pixels) * 2);
+	scalar.flat_field[t](&src[0],nb_pixels,&dark[0],&gain[0],(unsigned short*)ref.get());
+	simd.flat_field[t](&src[0],nb_pixels,&dark[0],&gain[0],(unsigned short*)out.get());
+	_check(ref == out,"flat field",level,nb_pixels,1);
+      }
+}
+
+int main()
+{
+  const Kernels::Table* scalar = Kernels::getTable(Kernels::Scalar);
+  printf("best SIMD level on this cpu: %s\n",
+	 Kernels::getSimdLevelName(Kernels::getBestSimdLevel()));
+
+  for(int l = Kernels::Scalar + 1;l < Kernels::NbSimdLevel;++l)
+    {
+      Kernels::SimdLevel level = Kernels::SimdLevel(l);
+      const Kernels::Table* table = Kernels::getTable(level);
+      if(!table || !Kernels::isSupported(level))
+	{
+	  printf("%s: not tested\n",Kernels::getSimdLevelName(level));
+	  continue;
+	}
+      srand(l);
+      _test_conv(*scalar,*table,level);
+      _test_crop(*scalar,*table,level);
+      _test_bin(*scalar,*table,level);
+      _test_stat(*scalar,*table,level);
+      _test_hdr(*scalar,*table,level);
+      _test_acc(*scalar,*table,level);
+      _test_flat_field(*scalar,*table,level);
+      printf("%s: tested\n",Kernels::getSimdLevelName(level));
+    }
+
+  if(nb_failures)
+    printf("%d failures\n",nb_failures);
+  return nb_failures ? 1 : 0;
+}
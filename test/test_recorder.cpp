@@ -0,0 +1,155 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2025
+// European Synchrotron Radiation Facility
+// CS40220 38043 Grenoble Cedex 9
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+
+// Recorder to RecordReader round trip: frames of various sizes spread
+// over several chunks are read back with their entries, from the
+// closed file (index) and from a copy cut as by a crash (the header
+// without index and the last frame truncated), which is scanned.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include <string>
+#include <vector>
+
+#include "V4L2Recorder.h"
+
+using namespace lima;
+using namespace lima::V4L2;
+
+static int nb_failures = 0;
+
+#define CHECK(cond)						\
+  do {								\
+    if(!(cond))							\
+      {								\
+	printf("FAILED: %s (line %d)\n",#cond,__LINE__);	\
+	++nb_failures;						\
+      }								\
+  } while(0)
+
+static const int nb_frames = 40;
+
+static size_t _frame_size(int frame_nb)
+{
+  return 1000 + (frame_nb * 3001) % 20000;
+}
+
+static std::vector<unsigned char> _frame(int frame_nb)
+{
+  std::vector<unsigned char> data(_frame_size(frame_nb));
+  for(size_t i = 0;i < data.size();++i)
+    data[i] = (unsigned char)(frame_nb * 13 + i);
+  return data;
+}
+
+// the first nb frames of reader must be the recorded ones
+static void _check_frames(RecordReader& reader,int nb)
+{
+  CHECK(reader.getNbFrames() == nb);
+  for(int i = 0;i < nb && i < reader.getNbFrames();++i)
+    {
+      const Recorder::FrameEntry& entry = reader.getFrameEntry(i);
+      std::vector<unsigned char> ref = _frame(i);
+      CHECK(entry.size == ref.size());
+      CHECK(entry.sequence == uint32_t(i + 100));
+      CHECK(entry.timestamp == 1000000LL * i);
+      CHECK(entry.pixelformat == V4L2_PIX_FMT_GREY);
+      CHECK(entry.width == ref.size() && entry.height == 1);
+      CHECK(entry.size == ref.size() &&
+	    !memcmp(reader.getFrameData(i),&ref[0],ref.size()));
+    }
+}
+
+static void _copy(const std::string& src,const std::string& dst,size_t size)
+{
+  FILE* in = fopen(src.c_str(),"rb");
+  FILE* out = fopen(dst.c_str(),"wb");
+  std::vector<char> data(size);
+  CHECK(in && out && fread(&data[0],1,size,in) == size &&
+	fwrite(&data[0],1,size,out) == size);
+  if(in) fclose(in);
+  if(out) fclose(out);
+}
+
+int main()
+{
+  const char* dir = getenv("TMPDIR");
+  char name[64];
+  snprintf(name,sizeof(name),"/lima_v4l2_test_%d.raw",int(getpid()));
+  std::string path = std::string(dir ? dir : "/tmp") + name;
+  std::string cut_path = path + ".cut";
+
+  try
+    {
+      Recorder recorder;
+      recorder.open(path,64 << 10);
+      for(int i = 0;i < nb_frames;++i)
+	{
+	  std::vector<unsigned char> data = _frame(i);
+	  Recorder::FrameEntry entry;
+	  memset(&entry,0,sizeof(entry));
+	  entry.size = data.size();
+	  entry.sequence = i + 100;
+	  entry.timestamp = 1000000LL * i;
+	  entry.pixelformat = V4L2_PIX_FMT_GREY;
+	  entry.width = data.size();
+	  entry.height = 1;
+	  entry.bytesperline = data.size();
+	  CHECK(recorder.addFrame(&data[0],entry));
+	}
+      CHECK(recorder.getNbFrames() == nb_frames);
+      recorder.close();
+      CHECK(!recorder.isOpen());
+
+      RecordReader reader(path);
+      _check_frames(reader,nb_frames);
+
+      // the index is lost and the last frame half written
+      const Recorder::FrameEntry& last = reader.getFrameEntry(nb_frames - 1);
+      _copy(path,cut_path,last.offset + last.size / 2);
+      FILE* cut = fopen(cut_path.c_str(),"r+b");
+      Recorder::Header header;
+      CHECK(cut && fread(&header,sizeof(header),1,cut) == 1);
+      header.nb_frames = 0;
+      header.index_offset = 0;
+      CHECK(cut && !fseek(cut,0,SEEK_SET) &&
+	    fwrite(&header,sizeof(header),1,cut) == 1);
+      if(cut) fclose(cut);
+
+      RecordReader cut_reader(cut_path);
+      _check_frames(cut_reader,nb_frames - 1);
+    }
+  catch(Exception&)
+    {
+      printf("FAILED: exception\n");
+      ++nb_failures;
+    }
+  unlink(path.c_str());
+  unlink(cut_path.c_str());
+
+  if(nb_failures)
+    printf("%d failures\n",nb_failures);
+  return nb_failures ? 1 : 0;
+}